@@ -0,0 +1,69 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace net
+{
+
+// 按大小分级的内存块池
+// 块的大小为 2 的幂, 从 MIN_BLOCK_SIZE 到 MAX_BLOCK_SIZE, 分配出的内存不做初始化;
+// 每个线程先从自己的缓存中取还块, 缓存满或为空时才访问加锁的全局空闲链表.
+// 池中保留的空闲内存 (含各线程缓存) 不超过上限, 超出的块直接还给系统
+class BufferPool
+{
+public:
+    static constexpr size_t MIN_BLOCK_SHIFT = 10;
+    static constexpr size_t MAX_BLOCK_SHIFT = 22;
+    static constexpr size_t MIN_BLOCK_SIZE = size_t(1) << MIN_BLOCK_SHIFT; // 1KB
+    static constexpr size_t MAX_BLOCK_SIZE = size_t(1) << MAX_BLOCK_SHIFT; // 4MB
+    static constexpr size_t CLASS_COUNT = MAX_BLOCK_SHIFT - MIN_BLOCK_SHIFT + 1;
+    // 每个线程在每个大小级别上缓存的块数
+    static constexpr size_t THREAD_CACHE_BLOCKS = 8;
+    // 默认保留的空闲内存上限
+    static constexpr size_t DEFAULT_MAX_RETAINED = size_t(64) << 20;
+
+    static BufferPool& instance();
+
+    // 分配至少 size 字节的块, size 被改写为块的实际大小
+    char* allocate(size_t& size);
+    // 归还 allocate 分配的块, size 为 allocate 返回的实际大小
+    void deallocate(char* block, size_t size);
+
+    // 设置保留的空闲内存上限, 设为 0 表示不保留
+    void set_max_retained(size_t bytes) { max_retained_.store(bytes, std::memory_order_relaxed); }
+    size_t max_retained() const { return max_retained_.load(std::memory_order_relaxed); }
+    // 当前保留的空闲内存
+    size_t retained() const { return retained_.load(std::memory_order_relaxed); }
+
+private:
+    BufferPool() = default;
+    ~BufferPool();
+
+    // 线程缓存在线程退出时把块还回全局链表
+    struct ThreadCache
+    {
+        std::array<std::vector<char*>, CLASS_COUNT> blocks;
+        ~ThreadCache();
+    };
+
+    struct FreeList
+    {
+        std::mutex mtx;
+        std::vector<char*> blocks;
+    };
+
+    static size_t class_of(size_t size);
+    static ThreadCache& thread_cache();
+    // 尝试将块计入保留内存, 超过上限时返回 false
+    bool retain(size_t size);
+
+    std::array<FreeList, CLASS_COUNT> free_lists_;
+    std::atomic<size_t> retained_{ 0 };
+    std::atomic<size_t> max_retained_{ DEFAULT_MAX_RETAINED };
+};
+
+} // namespace net
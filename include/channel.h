@@ -0,0 +1,198 @@
+#pragma once
+
+#include "net.h"
+#include "protocol.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <unordered_map>
+
+namespace net
+{
+
+// 一次 rpc 调用的结果状态
+enum class RpcStatus
+{
+    OK,
+    CONNECTION_CLOSED, // 连接断开, 请求可能未送达
+    TIMEOUT,           // 超过截止时间仍未收到响应
+    NO_HANDLER,        // 服务端没有对应的处理器
+    HANDLER_ERROR,     // 服务端处理器执行失败
+    BAD_REQUEST,       // 请求序列化失败
+    BAD_RESPONSE,      // 响应反序列化失败
+    NO_ENDPOINT,       // 服务没有可用的节点
+    OVERLOADED,        // 服务端过载, 请求未被处理, 可以稍后或换一个节点重试
+};
+
+using Deadline = std::chrono::steady_clock::time_point;
+
+// 当前线程正在同步执行的请求的截止时间, 不在处理请求或请求没有截止时间时为 Deadline::max()
+// Provider 在调用同步处理器期间设置, 处理器中经 async_call 或 call 发起的下游调用默认继承它
+Deadline current_deadline();
+
+// 在作用域内设置当前线程的 current_deadline, 退出时恢复原值
+class DeadlineScope
+{
+public:
+    explicit DeadlineScope(Deadline deadline);
+    ~DeadlineScope();
+
+    DeadlineScope(const DeadlineScope&) = delete;
+    DeadlineScope& operator=(const DeadlineScope&) = delete;
+
+private:
+    Deadline saved_;
+};
+
+// 响应回调, 在 io 线程中执行; 失败时 frame 为空帧
+// frame.body 只在回调期间有效, 需要保留时用 frame.share_body() 取得切片, 不必拷贝
+using ResponseCallback = std::function<void(RpcStatus status, const FrameView& frame)>;
+
+// 协程调用的结果
+template <typename ResponseType>
+struct RpcResult
+{
+    RpcStatus status = RpcStatus::OK;
+    ResponseType response;
+
+    bool ok() const { return status == RpcStatus::OK; }
+};
+
+// 把协程的完成处理器包装成响应回调: 在回调中反序列化响应, 再切换回协程所在的执行器恢复协程
+// 协程的完成处理器只能移动, 包装后放进可拷贝的回调中
+template <typename ResponseType, typename Handler>
+ResponseCallback resume_with_result(Handler handler)
+{
+    auto shared = std::make_shared<Handler>(std::move(handler));
+    return [shared](RpcStatus status, const FrameView& frame) {
+        RpcResult<ResponseType> result;
+        result.status = status;
+        if (status == RpcStatus::OK &&
+            !ProtocolTools::deserialize(frame.body.data(), frame.body.size(), &result.response)) {
+            result.status = RpcStatus::BAD_RESPONSE;
+        }
+
+        auto ex = asio::get_associated_executor(*shared);
+        asio::dispatch(ex, [shared, result = std::move(result)]() mutable {
+            (*shared)(std::move(result));
+        });
+    };
+}
+
+// 心跳参数
+// 连接超过 interval 没有收到任何数据时发送一个心跳帧, timeout 内仍未收到回复则认为对端已失效并断开连接,
+// 使 ChannelPool 在注册中心的租约过期之前就切换到其他节点
+struct HeartbeatOptions
+{
+    std::chrono::milliseconds interval{ 200 }; // 0 表示不发送心跳
+    std::chrono::milliseconds timeout{ 600 };
+};
+
+// 建立在单个 Client 连接上的 rpc 信道
+// 每个请求分配唯一的请求 id, 响应按 id 匹配到对应的调用方,
+// 因此同一连接上可以同时有多个请求在途, 响应也可以乱序返回
+class Channel : public std::enable_shared_from_this<Channel>
+{
+public:
+    // host 为 "unix:/path" 形式时连接该 Unix 域套接字, 忽略 port
+    Channel(asio::io_context& ioc, const std::string& host, const std::string& port);
+
+    void start();
+    void close();
+
+    // 连接断开且在途请求都已失败后回调, 在 io 线程中执行, 需在 start 之前设置
+    void set_close_callback(std::function<void()> cb) { close_cb_ = std::move(cb); }
+    // 连接是否已经断开, 断开后的调用都以 CONNECTION_CLOSED 结束; 不加锁, 可以在选择节点时频繁调用
+    bool closed();
+
+    // 连接本机的服务端时改用共享内存传输, 需在 start 之前调用
+    // 握手经由连接完成, 服务端不支持或映射失败时继续使用连接
+    void enable_shm(const ShmOptions& options = {}) { shm_options_ = options; }
+    // 发送是否已经切换到共享内存
+    bool using_shm() const { return client_ && client_->shm_active(); }
+
+    // 设置心跳参数, 需在 start 之前调用, 默认开启
+    void set_heartbeat(const HeartbeatOptions& options) { heartbeat_ = options; }
+
+    // 发起一次调用, 可在任意线程调用, 返回分配的请求 id
+    // method 为空时由服务端按消息类型匹配处理器; 超过 deadline 未收到响应以 TIMEOUT 结束
+    // 实际的截止时间取 deadline 与 current_deadline() 中较早的一个, 剩余时间随请求发给服务端
+    uint64_t async_call(ProtocolType type, const std::string& method, const std::string& body,
+                        ResponseCallback cb, Deadline deadline = Deadline::max());
+
+    // 取消一个在途请求, 之后不再回调它的回调, 稍后到达的响应直接丢弃; 请求已经结束时返回 false
+    bool cancel(uint64_t id);
+
+    // 协程方式调用, 挂起直到收到对应的响应或超时:
+    //     auto result = co_await channel->call<AddRequest, AddResponse>("Add", request, deadline);
+    // 协程在其自身的执行器上恢复, 不占用任何线程等待
+    template <typename RequestType, typename ResponseType>
+    asio::awaitable<RpcResult<ResponseType>> call(std::string method, const RequestType& request,
+                                                  Deadline deadline = Deadline::max())
+    {
+        constexpr ProtocolType type = std::is_base_of_v<google::protobuf::Message, RequestType>
+            ? ProtocolType::PROTOBUF : ProtocolType::JSON;
+
+        std::string body;
+        if (!ProtocolTools::serialize(request, &body)) {
+            co_return RpcResult<ResponseType>{ RpcStatus::BAD_REQUEST, ResponseType() };
+        }
+
+        auto initiation = [this, type, &method, &body, deadline](auto handler) {
+            async_call(type, method, body, resume_with_result<ResponseType>(std::move(handler)), deadline);
+        };
+
+        co_return co_await asio::async_initiate<decltype(asio::use_awaitable),
+            void(RpcResult<ResponseType>)>(std::move(initiation), asio::use_awaitable);
+    }
+
+    // 当前在途的请求数
+    size_t pending_size();
+    // 连接所在的 io_context, 回调都在它的线程中执行
+    asio::io_context& get_io_context() { return ioc_; }
+
+private:
+    // 在途请求
+    struct PendingCall
+    {
+        ResponseCallback cb;
+        TimerId timer = 0; // 截止时间在 io 线程的时间轮上的定时器, 未设置或尚未挂上时为 0
+    };
+
+    // 分配请求 id, 登记在途请求并发出请求帧
+    uint64_t send_request(ProtocolType type, const std::string& method, const std::string& body,
+                          uint8_t flags, ResponseCallback cb, Deadline deadline);
+    // 创建共享内存段并请求服务端映射
+    void start_shm();
+    void on_message(Buffer& recv);
+    void on_close();
+    void on_timeout(uint64_t id);
+    // 在时间轮上挂截止时间的定时器, 只在 io 线程中调用; 请求已经结束时不再挂
+    void arm_deadline(uint64_t id, Deadline deadline);
+    // 空闲时发送心跳, 并安排下一次检查
+    void heartbeat();
+    // 取出在途请求, 不存在时返回 false
+    bool take_pending(uint64_t id, PendingCall& call);
+
+    asio::io_context& ioc_;
+    std::string host_;
+    std::string port_;
+    std::shared_ptr<Client> client_;
+    std::function<void()> close_cb_;
+    std::optional<ShmOptions> shm_options_;
+    HeartbeatOptions heartbeat_;
+    // 最后一次收到数据的时间, 只在 io 线程中访问
+    std::chrono::steady_clock::time_point last_recv_;
+    bool ping_pending_{ false };
+
+    std::atomic<uint64_t> next_id_{ 1 };
+    std::mutex mtx_;
+    // 在途请求表: 请求 id -> 在途请求
+    std::unordered_map<uint64_t, PendingCall> pending_;
+    // 在 mtx_ 内写入, 与在途请求表一起变化; 读取不需要加锁
+    std::atomic<bool> closed_{ false };
+};
+
+} // namespace net
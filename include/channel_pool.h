@@ -0,0 +1,331 @@
+#pragma once
+
+#include "channel.h"
+#include "circuit_breaker.h"
+#include "endpoint_load.h"
+#include "hedge.h"
+#include "retry.h"
+#include "server.h"
+#include <array>
+#include <optional>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+namespace net
+{
+
+// 按服务名和节点地址组织的信道池
+// 节点上线时立即建立连接, 每个节点保持一条多路复用的长连接, 断开后只要节点仍在线就自动重连;
+// 所有连接共享同一组 io 线程, 每个线程运行自己的 io_context, 新连接轮询分配到各线程.
+// 调用按 P2C (power of two choices) 选择节点: 随机取两个可用节点, 选在途请求数与延迟移动平均综合得分较低的一个
+//
+// 与服务发现配合使用:
+//     auto pool = std::make_shared<net::ChannelPool>(2);
+//     auto discovery = std::make_shared<Tools::ServiceDiscovery>(etcd_addr,
+//         [pool](const std::string& s, const std::string& e) { pool->add_node(s, e); },
+//         [pool](const std::string& s, const std::string& e) { pool->remove_node(s, e); });
+class ChannelPool
+{
+public:
+    // 断线后重连的间隔
+    static constexpr std::chrono::milliseconds RECONNECT_INTERVAL{ 1000 };
+
+    explicit ChannelPool(size_t io_threads = 1);
+    ~ChannelPool();
+
+    ChannelPool(const ChannelPool&) = delete;
+    ChannelPool& operator=(const ChannelPool&) = delete;
+
+    // 节点上线, endpoint 为节点发布的地址列表, 形如 "host:port" 或 "host:port,unix:/path";
+    // 节点与本机同主机且发布了 Unix 域地址时连接改走 Unix 域套接字; 重复上线的节点忽略
+    void add_node(const std::string& service, const std::string& endpoint);
+    // 节点下线, 关闭对应的连接, 在途请求以 CONNECTION_CLOSED 结束
+    void remove_node(const std::string& service, const std::string& endpoint);
+
+    // 与本机节点的连接改用共享内存传输, 需在 add_node 之前调用, 见 Channel::enable_shm
+    void enable_shm(const ShmOptions& options = {}) { shm_options_ = options; }
+    // 设置之后建立的连接的心跳参数, 需在 add_node 之前调用, 见 HeartbeatOptions
+    void set_heartbeat(const HeartbeatOptions& options) { heartbeat_ = options; }
+    // 设置之后上线的节点的熔断参数, 需在 add_node 之前调用, 见 BreakerOptions; 默认开启
+    void set_breaker_options(const BreakerOptions& options) { breaker_options_ = options; }
+
+    // 按 P2C 选择服务的一个可用信道, 跳过熔断器未关闭的节点, 没有可用节点时返回空
+    std::shared_ptr<Channel> get(const std::string& service);
+    // 获取服务指定节点的信道, 节点不存在时返回空
+    std::shared_ptr<Channel> get(const std::string& service, const std::string& endpoint);
+    // 服务当前在线的节点
+    std::vector<std::string> endpoints(const std::string& service);
+
+    // 一个节点的状态
+    struct EndpointStats
+    {
+        std::string endpoint;
+        bool connected = false;
+        BreakerState breaker = BreakerState::CLOSED;
+        uint32_t inflight = 0;    // 经 call 发出、尚未结束的请求数
+        double latency_us = 0;    // 延迟的指数加权移动平均, 0 表示还没有样本
+        // 熔断器进入各状态的次数
+        uint64_t opened = 0;
+        uint64_t half_opened = 0;
+        uint64_t closed = 0;
+    };
+    // 服务当前在线的节点的状态
+    std::vector<EndpointStats> endpoint_stats(const std::string& service);
+
+    // 本进程的 Provider 以同名服务登记了该方法时是否直接调用其处理器, 默认开启, 见 call_local
+    void set_local_calls(bool enable) { local_calls_ = enable; }
+
+    // 设置服务一个方法的重试策略, method 为空时作为该服务其他方法的默认策略; 未设置时不重试
+    void set_retry_policy(const std::string& service, const std::string& method, const RetryPolicy& policy);
+    // 设置服务的重试预算, 见 RetryBudget; 未设置时每个服务使用默认预算 (重试数约为请求数的 10%)
+    void set_retry_budget(const std::string& service, double ratio, double max_tokens);
+    // 服务的重试预算, 可以读取其中的重试和拒绝次数
+    std::shared_ptr<RetryBudget> retry_budget(const std::string& service);
+
+    // 为服务的一个方法开启对冲请求, 见 HedgePolicy; 只应对幂等的方法开启
+    void set_hedge_policy(const std::string& service, const std::string& method, const HedgePolicy& policy);
+    // 方法的对冲状态, 可以读取其中的延迟分布和对冲次数; 未开启时返回空
+    std::shared_ptr<HedgeState> hedge_state(const std::string& service, const std::string& method);
+
+    // 选择服务的一个节点发起协程调用, 没有可用节点 (包括都已熔断) 时以 NO_ENDPOINT 结束
+    // 本进程提供了该服务时直接调用本地的处理器, 不经过连接; 截止时间同样继承 current_deadline()
+    // 按方法的重试策略重试失败的调用, 重试优先发往与上一次不同的节点, 本地调用不重试;
+    // 开启了对冲的方法每次尝试都可能同时发往两个节点, 取先到的响应
+    template <typename RequestType, typename ResponseType>
+    asio::awaitable<RpcResult<ResponseType>> call(std::string service, std::string method,
+                                                  const RequestType& request,
+                                                  Deadline deadline = Deadline::max())
+    {
+        deadline = std::min(deadline, current_deadline());
+        LocalMethod local;
+        if (local_calls_ && !method.empty() && LocalRegistry::instance().find(service, method, local)) {
+            co_return co_await call_local<RequestType, ResponseType>(std::move(local), std::move(method),
+                                                                     request, deadline);
+        }
+
+        MethodPolicy policies = method_policy(service, method);
+        const std::shared_ptr<const RetryPolicy>& policy = policies.retry;
+        const std::shared_ptr<RetryBudget>& budget = policies.budget;
+        const std::shared_ptr<HedgeState>& hedge = policies.hedge;
+        budget->deposit();
+
+        // 对冲的两个请求共用一份请求体, 在选择节点之前序列化, 失败时不占用节点
+        std::shared_ptr<const std::string> body;
+        if (hedge) {
+            auto serialized = std::make_shared<std::string>();
+            if (!ProtocolTools::serialize(request, serialized.get())) {
+                co_return RpcResult<ResponseType>{ RpcStatus::BAD_REQUEST, ResponseType() };
+            }
+            body = std::move(serialized);
+        }
+
+        std::string endpoint;
+        asio::io_context* last_ioc = nullptr; // 上一次尝试的节点所在的 io_context
+        for (int attempt = 1;; ++attempt) {
+            RpcResult<ResponseType> result;
+            Target target = pick(service, endpoint, true);
+            if (!target.channel) {
+                result.status = RpcStatus::NO_ENDPOINT;
+            } else if (hedge) {
+                endpoint = target.node->endpoint;
+                last_ioc = target.node->ioc;
+                result = co_await call_hedged<RequestType, ResponseType>(service, std::move(target), method,
+                                                                         body, deadline, hedge);
+            } else {
+                endpoint = target.node->endpoint;
+                last_ioc = target.node->ioc;
+                auto start = std::chrono::steady_clock::now();
+                result = co_await target.channel->call<RequestType, ResponseType>(method, request, deadline);
+                report(target, result.status, std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start));
+            }
+            if (result.ok() || attempt >= policy->max_attempts || !policy->retryable(result.status)) {
+                co_return result;
+            }
+
+            auto delay = policy->backoff(attempt);
+            if (deadline != Deadline::max() && Deadline::clock::now() + delay >= deadline) {
+                co_return result;
+            }
+            if (!budget->try_withdraw()) {
+                DBG("Retry budget of service {} exhausted, give up {} after {} attempts", service, method, attempt);
+                co_return result;
+            }
+            // 池在退避期间停止时不再有可用节点
+            if (delay.count() > 0 && !co_await sleep_for(last_ioc, delay)) {
+                result.status = RpcStatus::NO_ENDPOINT;
+                co_return result;
+            }
+        }
+    }
+
+    // 关闭所有连接并停止 io 线程
+    void stop();
+
+private:
+    struct Node;
+    using NodePtr = std::shared_ptr<Node>;
+    struct HedgedCall;
+
+    // 选中的节点和它当前的连接
+    struct Target
+    {
+        NodePtr node;
+        std::shared_ptr<Channel> channel;
+        uint64_t probe = 0; // 熔断器给出的探测凭证, 见 CircuitBreaker::allow
+    };
+
+    // 一次重试退避的等待, 时间到或池停止时结束, 只结束一次
+    struct Backoff
+    {
+        std::atomic<bool> finished{ false };
+        std::function<void(bool)> resume; // 以是否等满了 delay 恢复协程
+        asio::io_context* ioc = nullptr;
+        TimerId timer = 0;                // ioc 的时间轮上的定时器, 只在 ioc 线程中访问
+    };
+
+    // 协程在时间轮上等待 delay 后回到原来的执行器继续, 等待前或等待期间池已停止时返回 false
+    // 当前执行器是 io_context 时使用它的时间轮, 否则使用 fallback 的, 都没有时使用第一个 io 线程的
+    asio::awaitable<bool> sleep_for(asio::io_context* fallback, std::chrono::milliseconds delay);
+    // 结束一次退避等待, 重复调用时什么也不做
+    void finish_backoff(const std::shared_ptr<Backoff>& wait, bool slept);
+    bool stopped();
+
+    // 协程方式的对冲调用, 见 hedged_call
+    template <typename RequestType, typename ResponseType>
+    asio::awaitable<RpcResult<ResponseType>> call_hedged(const std::string& service, Target target,
+                                                         const std::string& method,
+                                                         std::shared_ptr<const std::string> body,
+                                                         Deadline deadline, std::shared_ptr<HedgeState> hedge)
+    {
+        constexpr ProtocolType type = std::is_base_of_v<google::protobuf::Message, RequestType>
+            ? ProtocolType::PROTOBUF : ProtocolType::JSON;
+
+        auto initiation = [&](auto handler) {
+            hedged_call(service, std::move(target), type, method, std::move(body), deadline, std::move(hedge),
+                        resume_with_result<ResponseType>(std::move(handler)));
+        };
+        co_return co_await asio::async_initiate<decltype(asio::use_awaitable),
+            void(RpcResult<ResponseType>)>(std::move(initiation), asio::use_awaitable);
+    }
+
+    // 向 target 发起调用, 超过方法的对冲延迟仍未返回时向服务的另一个节点发一个相同的备份请求;
+    // done 只回调一次: 先成功返回的响应胜出并取消另一个请求, 两个请求都失败时以后结束的为准
+    void hedged_call(const std::string& service, Target target, ProtocolType type, const std::string& method,
+                     std::shared_ptr<const std::string> body, Deadline deadline,
+                     std::shared_ptr<HedgeState> hedge, ResponseCallback done);
+
+    struct IoWorker
+    {
+        asio::io_context ioc{ 1 };
+        std::optional<asio::io_context::work> work;
+        std::thread thread;
+    };
+
+    // 服务的一个在线节点
+    struct Node
+    {
+        std::string service;
+        std::string endpoint;
+        asio::io_context* ioc = nullptr;  // 节点的连接固定在这个 io_context 上
+        // 受 mtx_ 保护, 替换后重新发布快照, 选择节点时读取快照中的副本
+        std::shared_ptr<Channel> channel;
+        bool removed = false;             // 受 mtx_ 保护
+        TimerId reconnect_timer = 0;      // ioc 的时间轮上的重连定时器, 只在 ioc 线程中访问
+        std::shared_ptr<CircuitBreaker> breaker;
+        EndpointLoad load;
+    };
+
+    // 服务名 -> 在线节点
+    using Services = std::unordered_map<std::string, std::vector<NodePtr>>;
+    // 快照中的一个节点和发布时它的连接
+    struct Route
+    {
+        NodePtr node;
+        std::shared_ptr<Channel> channel;
+    };
+    // 服务名 -> 路由
+    using Routes = std::unordered_map<std::string, std::vector<Route>>;
+
+    // 按 P2C 选择一个已连接且熔断器放行的节点, 有其他可用节点时跳过 avoid, 没有时返回空的 Target
+    // 两个候选都不可用时依次检查其余节点; 快照未变化时全程不加锁
+    // probe 为 true 时半开的节点也可以作为探测被选中, 选中的节点计入在途请求,
+    // 调用结束后必须以 report 报告结果, 或以 release 说明调用被取消; 为 false 时只选熔断器关闭的节点, 不计入统计
+    Target pick(const std::string& service, const std::string& avoid, bool probe);
+    // 报告发往 target 的一次调用的结果, 更新节点的熔断器和负载统计
+    void report(const Target& target, RpcStatus status, std::chrono::microseconds latency);
+    // 发往 target 的调用被取消, 没有结果
+    void release(const Target& target);
+    // 一个服务的重试策略、重试预算和对冲状态, 设置时在 mtx_ 内复制后整体替换, 调用时不加锁读取
+    struct ServicePolicy
+    {
+        // 方法名 -> 重试策略, 空方法名为服务的默认策略
+        std::unordered_map<std::string, std::shared_ptr<const RetryPolicy>> retries;
+        // 方法名 -> 对冲状态
+        std::unordered_map<std::string, std::shared_ptr<HedgeState>> hedges;
+        std::shared_ptr<RetryBudget> budget;
+    };
+    // 服务名 -> 策略, 与节点无关, 节点全部下线后仍然保留
+    using Policies = std::unordered_map<std::string, std::shared_ptr<const ServicePolicy>>;
+
+    // 选择节点和查找策略时读取的只读快照, 节点增减、重连或策略变化时在 mtx_ 内整体重建
+    struct Snapshot
+    {
+        Routes routes;
+        Policies policies;
+    };
+    // 一个线程独占的快照副本, 版本与 version_ 一致时直接使用, 否则在 mtx_ 内刷新.
+    // 读取只访问本线程的槽和只读的 version_, 线程之间不争用缓存行, 也不增减快照的引用计数
+    struct alignas(64) SnapshotSlot
+    {
+        std::atomic<uint64_t> owner{ 0 }; // 占用该槽的线程编号, 0 表示空闲; 线程退出后不归还
+        uint64_t version = 0;
+        std::shared_ptr<const Snapshot> snapshot;
+    };
+    static constexpr size_t SNAPSHOT_SLOTS = 64;
+
+    // 以 services_ 和 policies_ 重建快照并发布, 在 mtx_ 内调用
+    void publish();
+    // 当前线程看到的最新快照, 引用在本线程下一次调用 snapshot 之前有效;
+    // 槽都被其他线程占用时在 mtx_ 内取快照, 由 holder 持有
+    const Snapshot& snapshot(std::shared_ptr<const Snapshot>& holder);
+
+    // 一次调用用到的策略
+    struct MethodPolicy
+    {
+        std::shared_ptr<const RetryPolicy> retry; // 依次查找方法自己的和服务默认的策略, 都没有时不重试
+        std::shared_ptr<RetryBudget> budget;
+        std::shared_ptr<HedgeState> hedge;        // 未开启对冲时为空
+    };
+    // 不加锁地查找方法的策略; 服务第一次被调用时在 mtx_ 内为它创建默认的重试预算
+    MethodPolicy method_policy(const std::string& service, const std::string& method);
+    // 在 mtx_ 内修改服务的策略并发布, 服务还没有重试预算时创建默认的预算
+    template <typename Update>
+    void update_policy(const std::string& service, Update&& update);
+
+    // 为节点建立新的连接
+    void connect(const NodePtr& node);
+    // 节点的连接断开, 在 io 线程中执行
+    void on_channel_close(const NodePtr& node);
+
+    std::vector<std::unique_ptr<IoWorker>> workers_;
+    size_t next_worker_ = 0;
+    std::optional<ShmOptions> shm_options_;
+    HeartbeatOptions heartbeat_;
+    BreakerOptions breaker_options_;
+    std::atomic<bool> local_calls_{ true };
+
+    std::atomic<uint64_t> version_{ 1 };
+    std::array<SnapshotSlot, SNAPSHOT_SLOTS> slots_;
+
+    std::mutex mtx_;
+    Services services_;
+    Policies policies_;
+    std::shared_ptr<const Snapshot> snapshot_{ std::make_shared<const Snapshot>() };
+    // 正在等待的重试退避, stop 时提前结束
+    std::unordered_set<std::shared_ptr<Backoff>> backoffs_;
+    bool stopped_ = false;
+};
+
+} // namespace net
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "channel.h"
+#include "log.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace net
+{
+
+// 熔断器的状态
+enum class BreakerState : uint8_t
+{
+    CLOSED,    // 正常放行
+    OPEN,      // 熔断, 负载均衡跳过该节点
+    HALF_OPEN, // 熔断时间已过, 放行有限个探测请求
+};
+
+const char* to_string(BreakerState state);
+
+// 熔断参数
+// 最近 window 内的调用数不少于 min_requests 且失败率达到 error_rate 时熔断, open_duration 后进入半开,
+// 半开时最多放行 probes 个探测请求, 全部成功后恢复, 任何一个失败都重新熔断.
+// 连接断开、超时和过载算作失败, 耗时超过 slow_call 的成功调用也算作失败
+struct BreakerOptions
+{
+    bool enabled = true;
+    std::chrono::milliseconds window{ 10000 };
+    size_t buckets = 10; // 滑动窗口按时间分成的桶数
+    uint32_t min_requests = 20;
+    double error_rate = 0.5;
+    std::chrono::milliseconds slow_call{ 0 }; // 0 表示不按耗时判断
+    std::chrono::milliseconds open_duration{ 5000 };
+    uint32_t probes = 3;
+};
+
+// 一个节点的熔断器
+// allow 在选择节点时调用, 不加锁: 关闭和熔断中只读原子变量, 半开时以 CAS 占用探测名额,
+// 只有熔断到期转入半开的那一次加锁; record 在调用结束时更新滑动窗口.
+// 半开状态下放行的请求带有探测凭证, 只有本轮半开的探测结果决定恢复还是重新熔断
+class CircuitBreaker
+{
+public:
+    // name 只用于日志
+    CircuitBreaker(const BreakerOptions& options, std::string name);
+
+    CircuitBreaker(const CircuitBreaker&) = delete;
+    CircuitBreaker& operator=(const CircuitBreaker&) = delete;
+
+    // 是否放行一个请求; probe 为探测凭证, 不是探测请求时为 0
+    // 半开状态下放行时占用一个探测名额, 之后必须以 record 报告结果或以 release 归还
+    bool allow(uint64_t& probe);
+    // 报告一次放行的调用的结果, probe 为 allow 给出的凭证
+    void record(RpcStatus status, std::chrono::microseconds latency, uint64_t probe);
+    // 放行的调用被取消, 没有结果; 探测请求归还占用的名额
+    void release(uint64_t probe);
+
+    BreakerState state() const { return state_.load(std::memory_order_acquire); }
+    // 进入各状态的次数
+    uint64_t opened() const { return opened_.load(std::memory_order_relaxed); }
+    uint64_t half_opened() const { return half_opened_.load(std::memory_order_relaxed); }
+    uint64_t closed() const { return closed_.load(std::memory_order_relaxed); }
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    // 滑动窗口的一个桶, epoch 为桶覆盖的时间段编号
+    struct Bucket
+    {
+        int64_t epoch = -1;
+        uint32_t total = 0;
+        uint32_t failures = 0;
+    };
+
+    // 以下函数在持有 mtx_ 时调用
+    void transition(BreakerState to);
+    void reset_window();
+    int64_t epoch(clock::time_point now) const;
+
+    const BreakerOptions options_;
+    const clock::duration bucket_length_;
+    const std::string name_;
+
+    std::atomic<BreakerState> state_{ BreakerState::CLOSED };
+    std::atomic<clock::rep> open_until_{ 0 }; // 熔断结束的时刻
+    // 高 32 位为半开的轮次 (从 1 开始, 也是该轮探测请求的凭证), 低 32 位为该轮已放行的探测请求数
+    std::atomic<uint64_t> probes_{ 0 };
+
+    std::mutex mtx_;
+    std::vector<Bucket> window_;
+    uint32_t probe_successes_ = 0; // 本轮半开成功的探测请求数
+
+    std::atomic<uint64_t> opened_{ 0 };
+    std::atomic<uint64_t> half_opened_{ 0 };
+    std::atomic<uint64_t> closed_{ 0 };
+};
+
+} // namespace net
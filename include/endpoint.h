@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace net
+{
+
+// 节点地址
+// 单个地址形如 "host:port" 或 "unix:/run/svc.sock";
+// 节点可以把多个地址以逗号分隔一起发布, 如 "10.0.0.5:8080,unix:/run/svc.sock",
+// 同主机的调用方据此改走 Unix 域套接字, 其他调用方仍然使用 TCP 地址
+
+// Unix 域套接字地址的前缀
+inline constexpr const char UNIX_ENDPOINT_PREFIX[] = "unix:";
+
+// 是否为 Unix 域套接字地址
+bool is_unix_endpoint(const std::string& endpoint);
+// Unix 域套接字地址中的路径
+std::string unix_endpoint_path(const std::string& endpoint);
+
+// 把单个地址拆成 host 和 port, Unix 域地址的 host 为整个地址, port 为空; 格式错误时返回 false
+bool split_endpoint(const std::string& endpoint, std::string& host, std::string& port);
+// 拆分发布的地址列表
+std::vector<std::string> split_endpoints(const std::string& published);
+
+// host 是否指向本机: 回环地址、localhost、本机主机名或本机网卡上的地址
+bool is_local_host(const std::string& host);
+
+// 从节点发布的地址列表中选择本机连接时使用的地址
+// 列表中有 Unix 域地址, 且其套接字文件在本机存在, 同时节点的 TCP 地址指向本机 (或没有 TCP 地址) 时选择它,
+// 否则选择第一个 TCP 地址; 只有 Unix 域地址时选择它, 没有可用的地址时返回空
+std::string select_endpoint(const std::string& published);
+
+} // namespace net
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "channel.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace net
+{
+
+// 一个节点的负载, 供 P2C 负载均衡打分
+// 单独占一个缓存行, 不同 io 线程更新不同节点的统计时互不干扰; 读写都是原子操作, 选择节点时不加锁
+struct alignas(64) EndpointLoad
+{
+    // 指数加权移动平均中新样本的权重
+    static constexpr double DECAY = 0.2;
+
+    std::atomic<uint32_t> inflight{ 0 };
+    std::atomic<double> latency_us{ 0 }; // 延迟的移动平均, 0 表示还没有样本
+
+    void start() { inflight.fetch_add(1, std::memory_order_relaxed); }
+    // 调用结束; 只以成功和超时的耗时更新延迟, 快速失败的节点不应显得更快
+    void finish(RpcStatus status, std::chrono::microseconds latency);
+    // 调用被取消, 没有结果
+    void cancel() { inflight.fetch_sub(1, std::memory_order_relaxed); }
+
+    double latency() const { return latency_us.load(std::memory_order_relaxed); }
+    // 得分越低越优先: 延迟 * (在途请求数 + 1); 还没有样本时以 fallback 作为延迟
+    double score(double fallback) const;
+};
+
+} // namespace net
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "log.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace net
+{
+
+// 处理器的执行方式
+enum class ExecMode
+{
+    INLINE,    // 直接在 io 线程中执行, 适合极轻量的处理器
+    POOL,      // 在 Provider 共享的工作线程池中执行
+    DEDICATED, // 在该处理器独占的线程池中执行, 与其他处理器互不影响
+};
+
+using Task = std::function<void()>;
+
+// 通用的执行器接口
+class IExecutor {
+public:
+    virtual ~IExecutor() = default;
+    // 提交任务, 可在任意线程调用
+    virtual void submit(Task task) = 0;
+    // 停止执行器, 已提交的任务执行完后返回
+    virtual void stop() = 0;
+};
+
+// 工作窃取线程池
+// 每个工作线程拥有自己的双端队列: 工作线程内提交的任务压入自己队列的尾部并从尾部取出,
+// 保持缓存局部性; 自己的队列为空时从其他线程队列的头部窃取, 外部线程提交的任务轮询分配
+class WorkStealingPool : public IExecutor {
+public:
+    explicit WorkStealingPool(size_t threads, const std::string& name = "worker");
+    ~WorkStealingPool() override;
+
+    void submit(Task task) override;
+    void stop() override;
+
+    size_t size() const { return workers_.size(); }
+
+private:
+    struct Worker {
+        std::mutex mtx;
+        std::deque<Task> tasks;
+    };
+
+    void run(size_t index);
+    bool pop_local(size_t index, Task& task);
+    bool steal(size_t thief, Task& task);
+
+    std::string name_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+    std::atomic<size_t> next_{ 0 };
+
+    // 待执行的任务数与空闲线程数, 只有存在空闲线程时提交方才需要加锁唤醒
+    std::atomic<size_t> pending_{ 0 };
+    std::atomic<size_t> sleeping_{ 0 };
+    std::mutex sleep_mtx_;
+    std::condition_variable sleep_cv_;
+    std::atomic<bool> stopped_{ false };
+};
+
+} // namespace net
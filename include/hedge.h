@@ -0,0 +1,75 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace net
+{
+
+// 一个方法的对冲策略
+// 调用发出后超过该方法最近延迟的 percentile 分位仍未收到响应时, 向另一个节点发一个备份请求,
+// 取先到的响应并取消另一个; 备份请求每秒最多 max_per_second 个. 只应对幂等的方法开启
+struct HedgePolicy
+{
+    double percentile = 0.95;
+    std::chrono::milliseconds min_delay{ 1 }; // 对冲延迟的下限, 避免分位数很小时几乎每个请求都发两份
+    uint32_t max_per_second = 50;
+};
+
+// 最近 SIZE 次调用的延迟, 用于估计分位数
+class LatencyWindow
+{
+public:
+    static constexpr size_t SIZE = 512;
+    // 样本数少于此值时不给出分位数
+    static constexpr size_t MIN_SAMPLES = 32;
+
+    void record(std::chrono::microseconds latency);
+    // 第 p 分位的延迟, 样本不足时返回 0; 结果缓存, 每记录 RECOMPUTE 个样本才重新计算
+    std::chrono::microseconds percentile(double p);
+
+private:
+    static constexpr size_t RECOMPUTE = 32;
+
+    std::mutex mtx_;
+    std::array<int64_t, SIZE> samples_{};
+    size_t count_ = 0; // 已记录的样本数, 超过 SIZE 后覆盖最旧的
+    size_t stale_ = 0; // 上次计算分位数之后新记录的样本数
+    double cached_p_ = -1;
+    int64_t cached_ = 0;
+};
+
+// 按秒限速的令牌桶, 最多积累一秒的令牌
+class RateLimiter
+{
+public:
+    explicit RateLimiter(uint32_t per_second);
+
+    bool try_acquire();
+
+private:
+    const double rate_; // 每秒产生的令牌数, 也是桶的容量
+    std::mutex mtx_;
+    double tokens_;
+    std::chrono::steady_clock::time_point last_;
+};
+
+// 一个方法的对冲状态, 由同一方法的所有调用共享
+struct HedgeState
+{
+    explicit HedgeState(const HedgePolicy& p) : policy(p), limiter(p.max_per_second) {}
+
+    // 本次调用等待多久后发出备份请求, 样本不足时返回 0, 表示不对冲
+    std::chrono::microseconds delay();
+
+    const HedgePolicy policy;
+    LatencyWindow latency; // 调用方等待的时间, 从首个请求发出到调用结束, 包括超时的调用
+    RateLimiter limiter;
+    std::atomic<uint64_t> hedged{ 0 };     // 发出的备份请求数
+    std::atomic<uint64_t> backup_won{ 0 }; // 备份请求先返回的次数
+};
+
+} // namespace net
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace net
+{
+
+// 引用计数的内存块
+// 数据区来自 BufferPool, 或者直接接管一个 std::string, 最后一个引用释放时归还
+class IOBlock
+{
+public:
+    // 从 BufferPool 分配至少 capacity 字节的块, 初始引用计数为 1
+    static IOBlock* create(size_t capacity);
+    // 接管字符串的内存, 不做拷贝
+    static IOBlock* adopt(std::string data);
+
+    IOBlock(const IOBlock&) = delete;
+    IOBlock& operator=(const IOBlock&) = delete;
+
+    void add_ref() { refs_.fetch_add(1, std::memory_order_relaxed); }
+    void release();
+    // 存在其他引用时, 块中已有的数据不能再被改写
+    bool shared() const { return refs_.load(std::memory_order_acquire) > 1; }
+
+    char* data() { return data_; }
+    size_t capacity() const { return capacity_; }
+
+private:
+    IOBlock() = default;
+    ~IOBlock();
+
+    std::atomic<uint32_t> refs_{ 1 };
+    char* data_{ nullptr };
+    size_t capacity_{ 0 };
+    bool pooled_{ false };
+    std::string owned_; // adopt 接管的字符串
+};
+
+// 由若干块切片组成的缓冲区链
+// 拷贝 IOBuf 只增加块的引用计数, 不拷贝数据; 切片可以跨线程传递,
+// 所引用的块在最后一个切片释放前保持有效
+class IOBuf
+{
+public:
+    struct Slice
+    {
+        IOBlock* block;
+        size_t offset;
+        size_t length;
+
+        const char* data() const { return block->data() + offset; }
+    };
+
+    IOBuf() = default;
+    IOBuf(std::string data) { append(std::move(data)); }
+    ~IOBuf() { clear(); }
+
+    IOBuf(const IOBuf& other) { append(other); }
+    IOBuf& operator=(const IOBuf& other);
+    IOBuf(IOBuf&& other) noexcept;
+    IOBuf& operator=(IOBuf&& other) noexcept;
+
+    // 引用 block 中 [offset, offset + length) 的数据
+    void append(IOBlock* block, size_t offset, size_t length);
+    // 共享 other 的所有切片
+    void append(const IOBuf& other);
+    void append(IOBuf&& other);
+    // 接管字符串作为新的切片
+    void append(std::string data);
+    // 拷贝数据到新分配的块中
+    void append(const char* data, size_t size);
+
+    // 移除开头的 n 个字节
+    void pop_front(size_t n);
+    // 将开头的 n 个字节移动到 out 的末尾, 返回实际移动的字节数
+    size_t cut(IOBuf* out, size_t n);
+
+    void clear();
+    void swap(IOBuf& other) noexcept;
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const std::vector<Slice>& slices() const { return slices_; }
+
+    // 数据是否位于同一段连续内存中
+    bool contiguous() const { return slices_.size() <= 1; }
+    // 连续数据的视图, 不连续时返回空视图
+    std::string_view view() const;
+    // 拷贝出全部数据
+    std::string to_string() const;
+
+private:
+    std::vector<Slice> slices_;
+    size_t size_{ 0 };
+};
+
+} // namespace net
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+namespace net
+{
+
+class IMessageHandler;
+class IExecutor;
+
+// 进程内注册的一个方法
+struct LocalMethod
+{
+    std::shared_ptr<IMessageHandler> handler;
+    std::shared_ptr<IExecutor> executor; // 为空表示在调用方的线程中直接执行
+};
+
+// 进程内的服务表
+// 同一进程既运行 Provider 又调用其服务时, Provider 以服务名登记自己的处理器,
+// ChannelPool 按服务名和方法名在这里找到处理器直接调用, 不经过套接字, 见 call_local
+class LocalRegistry
+{
+public:
+    static LocalRegistry& instance();
+
+    // 登记 owner 提供的服务, 同名服务已经登记时覆盖
+    void add(const std::string& service, const void* owner,
+             std::unordered_map<std::string, LocalMethod> methods);
+    // 注销 owner 登记的服务, 服务已经被其他 owner 覆盖时不做处理
+    void remove(const std::string& service, const void* owner);
+    // 查找服务的方法, 不存在时返回 false
+    bool find(const std::string& service, const std::string& method, LocalMethod& result);
+
+private:
+    struct Entry
+    {
+        const void* owner = nullptr;
+        std::unordered_map<std::string, LocalMethod> methods;
+    };
+
+    std::shared_mutex mtx_;
+    std::unordered_map<std::string, Entry> services_;
+    // 登记的服务数, 没有任何服务时查找不必加锁
+    std::atomic<size_t> size_{ 0 };
+};
+
+} // namespace net
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace net
+{
+
+// 计入内存预算的内存类别
+enum class MemoryCategory
+{
+    RECV_BUFFER, // 会话的接收缓冲区
+    REQUEST,     // 交给执行器或协程、尚未处理完的请求
+    RESPONSE,    // 排队待发送的响应
+    COUNT,
+};
+
+// 进程内一组会话共享的内存预算
+// 接收缓冲区和待发送的响应已经分配, 只做统计; 新请求进入处理前先申请预算,
+// 总用量达到上限后服务端不再解析新请求, 直接以 OVERLOADED 响应
+class MemoryBudget
+{
+public:
+    // limit 为 0 表示不限制, 只做统计
+    explicit MemoryBudget(size_t limit = 0) : limit_(limit) {}
+
+    MemoryBudget(const MemoryBudget&) = delete;
+    MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+    // 计入或扣除已经发生的分配, 不受上限约束
+    void add(MemoryCategory category, size_t bytes);
+    void sub(MemoryCategory category, size_t bytes);
+    // 预算足够时计入并返回 true, 否则记一次拒绝并返回 false
+    bool try_acquire(MemoryCategory category, size_t bytes);
+
+    // 总用量是否已达上限
+    bool exhausted() const { return limit_ && used() >= limit_; }
+    // 记一次因预算耗尽被拒绝的请求
+    void reject() { rejected_.fetch_add(1, std::memory_order_relaxed); }
+
+    size_t limit() const { return limit_; }
+    size_t used() const { return total_.load(std::memory_order_relaxed); }
+    size_t used(MemoryCategory category) const {
+        return used_[static_cast<size_t>(category)].load(std::memory_order_relaxed);
+    }
+    uint64_t rejected() const { return rejected_.load(std::memory_order_relaxed); }
+
+private:
+    const size_t limit_;
+    std::atomic<size_t> total_{ 0 };
+    std::array<std::atomic<size_t>, static_cast<size_t>(MemoryCategory::COUNT)> used_{};
+    std::atomic<uint64_t> rejected_{ 0 };
+};
+
+} // namespace net
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+namespace net
+{
+
+// 无锁的多生产者单消费者队列
+// 生产者以 CAS 压入链表头, 消费者一次性取走整条链表后反转为入队顺序,
+// 因为消费者总是整体取走, 不存在 ABA 问题
+template <typename T>
+class MpscQueue
+{
+public:
+    MpscQueue() = default;
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    ~MpscQueue() {
+        consume_all([](T&&) {});
+    }
+
+    // 入队, 可在任意线程调用
+    // 返回 true 表示入队前队列为空, 调用方据此决定是否需要唤醒消费者
+    bool push(T value) {
+        Node* node = new Node{ std::move(value), nullptr };
+        Node* old = head_.load(std::memory_order_relaxed);
+        do {
+            node->next = old;
+        } while (!head_.compare_exchange_weak(old, node,
+            std::memory_order_release, std::memory_order_relaxed));
+        return old == nullptr;
+    }
+
+    // 取出当前所有元素并按入队顺序回调, 只能由唯一的消费者调用
+    template <typename Func>
+    size_t consume_all(Func&& func) {
+        Node* list = head_.exchange(nullptr, std::memory_order_acquire);
+
+        // 反转链表, 恢复入队顺序
+        Node* ordered = nullptr;
+        while (list) {
+            Node* next = list->next;
+            list->next = ordered;
+            ordered = list;
+            list = next;
+        }
+
+        size_t count = 0;
+        while (ordered) {
+            Node* next = ordered->next;
+            func(std::move(ordered->value));
+            delete ordered;
+            ordered = next;
+            ++count;
+        }
+        return count;
+    }
+
+    bool empty() const {
+        return head_.load(std::memory_order_acquire) == nullptr;
+    }
+
+private:
+    struct Node
+    {
+        T value;
+        Node* next;
+    };
+
+    std::atomic<Node*> head_{ nullptr };
+};
+
+} // namespace net
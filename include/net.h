@@ -1,7 +1,18 @@
 #pragma once
 
 #include "command.h"
+#include "endpoint.h"
 #include "log.h"
+#include "buffer_pool.h"
+#include "iobuf.h"
+#include "memory_budget.h"
+#include "mpsc_queue.h"
+#include "protocol.h"
+#include "shm_ring.h"
+#include "timer_wheel.h"
+#include "uring.h"
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <boost/asio.hpp>
 
@@ -11,11 +22,20 @@ namespace asio = boost::asio;
 namespace net
 {
 
+// 接收缓冲区, 内存块来自 BufferPool, 分配和扩容时不做清零
+// 可以通过 slice() 把已接收的数据以切片的形式零拷贝地交出去, 块被切片引用期间
+// 已有的数据不会被覆盖或搬移, 之后的数据写到后面或新的块中
 class Buffer
 {
 public:
     Buffer() = default;
     Buffer(size_t size);
+    ~Buffer();
+
+    Buffer(const Buffer&) = delete;
+    Buffer& operator=(const Buffer&) = delete;
+    Buffer(Buffer&& other) noexcept;
+    Buffer& operator=(Buffer&& other) noexcept;
     
     std::string read_as_string(size_t size);
     size_t capacity() const;
@@ -32,71 +52,250 @@ public:
     size_t readable_size() const;
     void advance_write(size_t size);
     void advance_read(size_t size);
+    // 清空并把内存块还给池
+    void release();
+    // 引用可读区域中 [data, data + size) 的数据, 不做拷贝
+    IOBuf slice(const char* data, size_t size);
+    // 当前的内存块, 用于在其上建立切片
+    IOBlock* block() const { return block_; }
 
 private:
-    std::vector<char> buffer_;
+    // 换成至少 size 字节的新块, 只搬移未读的数据
+    void reallocate(size_t size);
+    // 数据读完后回到块的开头, 块仍被切片引用时保持原位
+    void rewind();
+
+    IOBlock* block_{ nullptr };
+    char* data_{ nullptr };
+    size_t capacity_{ 0 };
     size_t read_pos_{ 0 };
     size_t write_pos_{ 0 };
 };
 
-using OnMsgCallback = std::function<void(Buffer& recv, Buffer* send)>;
+// 待发送的数据, 每个切片对应一个 iovec, 发送时整体作为一次聚集写
+// 响应体可以直接引用接收缓冲区或其他块中的数据, 不必拷贝进帧
+using WriteBatch = IOBuf;
+
+class Session;
+using SessionPtr = std::shared_ptr<Session>;
+
+// 会话与客户端使用的流式套接字, TCP 与 Unix 域套接字共用同一套读写和分帧逻辑
+using StreamSocket = asio::generic::stream_protocol::socket;
+
+// recv 为会话的接收缓冲区, 同步产生的响应追加到 send 中;
+// 异步完成的响应通过 session->send() 发送
+using OnMsgCallback = std::function<void(const SessionPtr& session, Buffer& recv, WriteBatch* send)>;
 using CliOnMsgCallback = std::function<void(Buffer& recv)>;
+using CliOnCloseCallback = std::function<void()>;
+
+// 会话的流量控制参数, 各项为 0 表示不限制
+// 在途请求数或待发送字节数超过上限 (高水位) 时暂停读取, 降到上限的 low_watermark 倍 (低水位) 以下后恢复,
+// 暂停期间对端的数据留在内核缓冲区中, 由 TCP 流量控制把压力传回对端
+struct SessionLimits
+{
+    // 接收缓冲区中尚未处理的字节数上限, 即单个帧的最大长度, 超过时断开会话
+    size_t max_inbound_bytes = FrameHeader::SIZE + FrameHeader::MAX_BODY_LENGTH;
+    // 交给执行器或协程、尚未发出响应的请求数上限
+    size_t max_inflight = 4096;
+    // 排队待发送的字节数上限
+    size_t max_outbound_bytes = 64 * 1024 * 1024;
+    // 低水位相对高水位的比例
+    double low_watermark = 0.5;
+    // 待发送字节数持续超过上限的会话视为读取过慢的对端, 超过该时长后断开
+    std::chrono::milliseconds evict_after{ 10000 };
+    // 超过该时长没有收发任何数据的会话被关闭, 0 表示不检查; 开启心跳的客户端空闲时也会定期发送心跳
+    std::chrono::milliseconds idle_timeout{ 60000 };
+};
 
 class Session : public std::enable_shared_from_this<Session>
 {
 public:
     Session(asio::io_context& io_context,
-            ip::tcp::socket socket,
+            StreamSocket socket,
+            OnMsgCallback on_msg_callback);
+    // io_uring 模式下由多发 accept 得到的连接
+    Session(asio::io_context& io_context,
+            int fd,
             OnMsgCallback on_msg_callback);
+    ~Session();
     void start();
     void close();
 
+    // 将数据加入发送队列, 可在任意线程调用
+    // 其他线程发送的数据先进入无锁队列, 再由会话所在的 io 线程取出批量发送
+    void send(IOBuf data);
+
+    // 需在 start 之前设置
+    void set_limits(const SessionLimits& limits) { limits_ = limits; }
+    // 接收缓冲区和待发送数据计入的内存预算, 需在 start 之前设置
+    void set_memory_budget(std::shared_ptr<MemoryBudget> budget) { budget_ = std::move(budget); }
+    // 请求交给执行器或协程异步处理, 计入在途请求数, 只能在 io 线程中调用
+    void request_started() { inflight_.fetch_add(1, std::memory_order_relaxed); }
+    // 发送异步处理完成的响应并结束一个在途请求, 可在任意线程调用; data 可以为空
+    void finish_request(IOBuf data);
+    // 在途请求数或待发送字节数已达上限, 消息回调应停止解析, 剩余的帧留在接收缓冲区中,
+    // 恢复读取后再次交给回调; 只能在 io 线程中调用
+    bool overloaded() const;
+
+    // 会话所在 io 线程的执行器
+    asio::io_context::executor_type get_executor() { return ioc_.get_executor(); }
+
+    // 最近一次读到数据的时间, 接收缓冲区中的帧都不晚于此时到达, 用作请求剩余时间的起点;
+    // 暂停读取期间积压的帧恢复处理时仍以原来的时间计算. 只能在 io 线程中调用
+    std::chrono::steady_clock::time_point received_at() const { return received_at_; }
+
+    // 映射客户端创建的共享内存段, 之后的发送都写入共享内存, 段中收到的数据与套接字数据一样交给回调;
+    // 套接字继续保持, 用于检测客户端断开. 只能在 io 线程中调用
+    bool attach_shm(const std::string& name, const ShmOptions& options);
+
 private:
     void do_read();
-    void do_write(const std::string& data);
+    void do_write();
+    void flush_outbox();
+    // 处理接收缓冲区中的数据, 并发出同步产生的响应; replay 表示重新处理暂停期间积压的帧, 没有新数据
+    void on_read(Buffer& recv, bool replay = false);
+    void on_written(const boost::system::error_code& ec);
+    // 按在途请求数和待发送字节数暂停或恢复读取, 并检查读取过慢的对端; 只在 io 线程中调用
+    void update_flow();
+    void pause_read();
+    void resume_read();
+    size_t outbound_size() const;
+    // 把接收缓冲区容量和待发送字节数的变化同步到内存预算
+    void update_budget();
+    // 空闲超时则关闭会话, 否则在剩余时间后再次检查
+    void check_idle();
 
+    asio::io_context& ioc_;
     Buffer read_;
-    ip::tcp::socket socket_;
+    StreamSocket socket_;
     OnMsgCallback cb_;
+
+    // 流量控制, 除 inflight_ 外只在 io 线程访问
+    SessionLimits limits_;
+    std::atomic<size_t> inflight_{ 0 };
+    bool reading_{ false };     // asio 模式下有挂起的读操作
+    bool read_paused_{ false };
+    bool slow_{ false };        // 待发送字节数超过上限, evict_timer_ 在计时
+    bool evicted_{ false };     // 因超出限制被断开, 之后收到的数据直接丢弃
+    std::chrono::steady_clock::time_point last_active_; // 最后一次收发数据的时间
+    std::chrono::steady_clock::time_point received_at_; // 最后一次读到数据的时间
+    TimerId evict_timer_{ 0 };  // 时间轮上的驱逐定时器
+
+    std::shared_ptr<MemoryBudget> budget_;
+    size_t budget_recv_{ 0 };   // 已计入预算的接收缓冲区字节数
+    size_t budget_send_{ 0 };   // 已计入预算的待发送字节数
+
+    // io_uring 模式下代替 socket_ 读写, 此时 uring_fd_ 为其套接字
+    std::atomic<int> uring_fd_{ -1 };
+#ifdef NET_HAS_IO_URING
+    std::unique_ptr<UringStream> stream_;
+#endif
+    // 共享内存传输, 建立后代替套接字发送
+    std::shared_ptr<ShmStream> shm_;
+
+    // 发送队列, 只在 io 线程访问; 同一时刻只有一个 async_write 在进行
+    // write_queue_ 收集上次发送以来排队的数据, writing_ 持有正在发送的数据直到写完成
+    WriteBatch write_queue_;
+    WriteBatch writing_;
+    std::vector<asio::const_buffer> iov_;
+
+    // 其他线程提交的待发送数据
+    MpscQueue<IOBuf> outbox_;
 };
 
 class Server : public std::enable_shared_from_this<Server>
 {
 public:
-    Server(asio::io_context& ioc, int port, OnMsgCallback cb);
+    // reuse_port 为 true 时设置 SO_REUSEPORT, 允许多个 Server 绑定同一端口,
+    // 由内核在各个监听套接字之间分配新连接
+    Server(asio::io_context& ioc, int port, OnMsgCallback cb, bool reuse_port = false);
+    // 在 Unix 域套接字 path 上监听, 已存在的套接字文件会被替换, 停止后删除
+    Server(asio::io_context& ioc, const std::string& path, OnMsgCallback cb);
+    ~Server();
     void start();
     void stop();
 
+    // 新会话使用的流量控制参数, 需在 start 之前设置
+    void set_session_limits(const SessionLimits& limits) { limits_ = limits; }
+    // 新会话计入的内存预算, 需在 start 之前设置
+    void set_memory_budget(std::shared_ptr<MemoryBudget> budget) { budget_ = std::move(budget); }
+
 private:
     void do_accept();
+    void start_uring(UringContext& uring);
 
     asio::io_context& ioc_;
-    asio::ip::tcp::acceptor acceptor_;
+    asio::basic_socket_acceptor<asio::generic::stream_protocol> acceptor_;
     OnMsgCallback cb_;
+    SessionLimits limits_;
+    std::shared_ptr<MemoryBudget> budget_;
+    // 监听的地址, 用于日志; Unix 域套接字的路径, 非空时析构时删除
+    std::string local_address_;
+    std::string unix_path_;
+
+    // io_uring 模式下监听套接字从 acceptor_ 中取出, 由多发 accept 接受新连接
+    UringContext* uring_{ nullptr };
+#ifdef NET_HAS_IO_URING
+    UringOp accept_op_;
+#endif
+    int listen_fd_{ -1 };
+    bool stopping_{ false };
 };
 
 class Client : public std::enable_shared_from_this<Client>
 {
 public:
+    // host 为 "unix:/path" 形式时连接该 Unix 域套接字, 忽略 port
     Client(asio::io_context& ioc, 
            const std::string& host, 
            const std::string& port, 
            CliOnMsgCallback cb);
     void start();
-    void send(const std::string& data);
+    void send(IOBuf data);
     void close();
 
+    // 连接失败或断开时回调, 在 io 线程中执行
+    void set_close_callback(CliOnCloseCallback cb) { close_cb_ = std::move(cb); }
+
+    // 创建共享内存段并开始接收其中的数据, 返回段名, 失败时返回空; 需在 start 之前调用
+    // 段名通过连接告知服务端, 服务端映射成功后调用 use_shm(true) 把发送切换到共享内存,
+    // 失败时调用 use_shm(false) 释放共享内存段, 继续使用套接字
+    std::string create_shm(const ShmOptions& options);
+    void use_shm(bool ok);
+    // 发送是否已经切换到共享内存
+    bool shm_active() const { return shm_active_.load(std::memory_order_acquire); }
+
 private:
-    void do_connect(const ip::tcp::resolver::results_type& endpoints);
+    void do_connect(const std::vector<asio::generic::stream_protocol::endpoint>& endpoints);
     void do_read();
+    void do_write();
+    void on_read(Buffer& recv);
+    void on_written(const boost::system::error_code& ec);
+    void handle_close();
 
     asio::io_context& ioc_;
     asio::ip::tcp::resolver resolver_;
     std::string host_;
     std::string port_;
-    asio::ip::tcp::socket socket_;
+    StreamSocket socket_;
     CliOnMsgCallback cb_;
+    CliOnCloseCallback close_cb_;
     Buffer read_;
+
+    // io_uring 模式下连接建立后代替 socket_ 读写, close() 可能在其他线程通过 uring_fd_ 关闭连接
+    std::atomic<int> uring_fd_{ -1 };
+#ifdef NET_HAS_IO_URING
+    std::unique_ptr<UringStream> stream_;
+#endif
+    // 共享内存传输, shm_active_ 之后代替套接字发送
+    std::shared_ptr<ShmStream> shm_;
+    std::atomic<bool> shm_active_{ false };
+
+    // 发送队列, 连接建立前发送的数据也会暂存在这里
+    WriteBatch write_queue_;
+    WriteBatch writing_;
+    std::vector<asio::const_buffer> iov_;
+    bool connected_{ false };
 };
 
 } // namespace net
@@ -2,45 +2,184 @@
 #pragma once
 #include <google/protobuf/message.h>
 #include <jsoncpp/json/json.h>
+#include "iobuf.h"
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
 
-// 支持协议的消息类型
-enum class ProtocolType
+// 支持协议的消息类型, 取值即二进制帧头中的 codec 字节
+enum class ProtocolType : uint8_t
 {
-    PROTOBUF,
-    JSON,
+    PROTOBUF = 0,
+    JSON = 1,
+};
+
+// 线上协议版本, 由帧的首字节区分: 旧版文本帧总是以 ASCII 数字开头
+enum class WireVersion : uint8_t
+{
+    TEXT = 0,   // 旧版 "长度\r\n类型\r\n数据\r\n" 文本帧
+    BINARY = 1, // 定长二进制帧头
+};
+
+// 帧解析结果
+enum class ParseResult
+{
+    OK,
+    INCOMPLETE, // 数据不完整, 需要等待更多数据
+    INVALID,    // 格式错误
+};
+
+// 响应状态码, 写在二进制帧头的 status 字节中
+enum class StatusCode : uint8_t
+{
+    OK = 0,
+    NO_HANDLER = 1,    // 没有匹配的处理器
+    HANDLER_ERROR = 2, // 处理器解析请求或执行失败
+    OVERLOADED = 3,    // 服务端内存预算耗尽, 请求未被处理
+};
+
+// 心跳控制帧的方法名, 消息体为空, 服务端收到后立即回复空响应
+inline constexpr const char PING_METHOD[] = "__ping";
+
+// 帧头中的标志位
+enum FrameFlag : uint8_t
+{
+    FLAG_RESPONSE = 0x01, // 响应帧, request_id 与对应请求一致
+    FLAG_CONTROL = 0x02,  // 传输层的控制帧, 由框架自身处理, 不交给处理器
+    FLAG_DEADLINE = 0x04, // 帧头之后带有 4 字节的剩余时间, 见 FrameHeader::timeout_ms
+};
+
+// 二进制帧头, 固定 20 字节, 多字节字段使用网络字节序
+// | magic(2) | version(1) | flags(1) | codec(1) | status(1) | method_length(2) | request_id(8) | body_length(4) |
+// 设置了 FLAG_DEADLINE 时紧跟 4 字节的 timeout_ms, 之后依次是 method_length 字节的方法名和 body_length 字节的消息体
+struct FrameHeader
+{
+    static constexpr uint16_t MAGIC = 0x4352; // "CR"
+    static constexpr size_t SIZE = 20;
+    static constexpr size_t DEADLINE_SIZE = 4;
+    static constexpr uint32_t MAX_BODY_LENGTH = 64 * 1024 * 1024;
+
+    uint8_t version = static_cast<uint8_t>(WireVersion::BINARY);
+    uint8_t flags = 0;
+    ProtocolType codec = ProtocolType::PROTOBUF;
+    StatusCode status = StatusCode::OK;
+    uint16_t method_length = 0;
+    uint64_t request_id = 0;
+    uint32_t body_length = 0;
+    // 请求的剩余时间, 单位毫秒, 只在设置了 FLAG_DEADLINE 时编码; 按发送时刻计算, 不依赖两端的时钟同步
+    uint32_t timeout_ms = 0;
+
+    // 编码后的长度, 包括可选的剩余时间
+    size_t length() const { return SIZE + ((flags & FLAG_DEADLINE) ? DEADLINE_SIZE : 0); }
+
+    // 将帧头写入 out, out 至少有 length() 字节
+    void encode(char* out) const;
+
+    // 直接从 data 原地解析帧头, 不产生临时字符串
+    static ParseResult decode(const char* data, size_t len, FrameHeader* header);
+};
+
+// 解码出的帧视图, body 直接指向底层接收缓冲区
+// 只在该缓冲区被消费或追加数据之前有效, 需要保留时用 share_body() 取得切片
+struct FrameView
+{
+    WireVersion version = WireVersion::BINARY;
+    uint8_t flags = 0;
+    ProtocolType type = ProtocolType::PROTOBUF;
+    StatusCode status = StatusCode::OK;
+    uint64_t request_id = 0;
+    uint32_t timeout_ms = 0; // 请求的剩余时间, 0 表示调用方没有设置截止时间
+    std::string_view method; // 为空表示未指定方法, 由服务端按消息类型匹配处理器
+    std::string_view body;
+    net::IOBlock* block = nullptr; // body 所在的引用计数块, 为空时 body 无法共享
+
+    // 取得消息体的切片, 位于引用计数块中时只增加引用, 否则拷贝
+    net::IOBuf share_body() const {
+        net::IOBuf buf;
+        if (block) {
+            buf.append(block, body.data() - block->data(), body.size());
+        } else {
+            buf.append(body.data(), body.size());
+        }
+        return buf;
+    }
+};
+
+// 流式帧解码器: 在一段连续内存上一次线性扫描出所有完整帧, 不做任何拷贝
+// 用法: 反复调用 next() 直到返回非 OK, 再按 consumed() 一次性消费缓冲区
+class FrameDecoder
+{
+public:
+    FrameDecoder(const char* data, size_t len) : data_(data), len_(len) {}
+
+    // 解析下一帧, INCOMPLETE 表示剩余数据不足一帧
+    ParseResult next(FrameView& frame);
+
+    // 已解析的完整帧占用的字节数
+    size_t consumed() const { return pos_; }
+
+private:
+    const char* data_;
+    size_t len_;
+    size_t pos_{ 0 };
 };
 
 class ProtocolTools
 {
 public:
     // LV协议结构：length + gap + data
+    // version 为 BINARY 时使用二进制帧头, 为 TEXT 时保持旧版文本格式以兼容旧节点
     struct LVProtocol
     {
         ProtocolType type;
         int length;
         std::string data;
         std::string gap;
-        
+        WireVersion version;
+        uint8_t flags;
+        StatusCode status;
+        uint64_t request_id;
+        uint32_t timeout_ms; // 非 0 时以 FLAG_DEADLINE 带上剩余时间, 旧版文本帧不携带
+        std::string method; // 旧版文本帧不携带方法名
+
         // 默认构造函数
-        LVProtocol() : type(ProtocolType::PROTOBUF), length(0), gap("\r\n") {}
-        
+        LVProtocol() : type(ProtocolType::PROTOBUF), length(0), gap("\r\n"),
+            version(WireVersion::BINARY), flags(0), status(StatusCode::OK), request_id(0), timeout_ms(0) {}
+
         // 带参构造函数
         LVProtocol(ProtocolType t, const std::string& d, const std::string& g = "\r\n")
-            : type(t), data(d), gap(g) {
+            : type(t), data(d), gap(g), version(WireVersion::BINARY), flags(0),
+              status(StatusCode::OK), request_id(0), timeout_ms(0) {
             length = data.size();
         }
-        
+
         // 转换为完整的协议字符串
         std::string to_string() const {
             std::string result;
-            
+            if (version == WireVersion::BINARY) {
+                FrameHeader header;
+                header.flags = timeout_ms ? (flags | FLAG_DEADLINE) : (flags & ~FLAG_DEADLINE);
+                header.codec = type;
+                header.status = status;
+                header.method_length = static_cast<uint16_t>(method.size());
+                header.request_id = request_id;
+                header.body_length = static_cast<uint32_t>(data.size());
+                header.timeout_ms = timeout_ms;
+
+                result.reserve(header.length() + method.size() + data.size());
+                result.resize(header.length());
+                header.encode(result.data());
+                result += method;
+                result += data;
+                return result;
+            }
+
             // 添加长度字段
             result += std::to_string(length);
             result += gap;
-            
+
             // 添加数据类型标识
             if (type == ProtocolType::PROTOBUF) {
                 result += "PB";
@@ -48,61 +187,31 @@ public:
                 result += "JS";
             }
             result += gap;
-            
+
             // 添加数据
             result += data;
             result += gap;
-            
+
             return result;
         }
-        
+
+        // 从帧视图拷贝出完整消息
+        void from_frame(const FrameView& frame) {
+            version = frame.version;
+            type = frame.type;
+            flags = frame.flags;
+            status = frame.status;
+            request_id = frame.request_id;
+            timeout_ms = frame.timeout_ms;
+            method.assign(frame.method.data(), frame.method.size());
+            length = static_cast<int>(frame.body.size());
+            data.assign(frame.body.data(), frame.body.size());
+        }
+
         // 从字符串解析
         bool from_string(const std::string& str) {
-            size_t pos = 0;
-            
-            // 解析长度字段
-            size_t len_end = str.find(gap, pos);
-            if (len_end == std::string::npos) {
-                return false;
-            }
-            
-            std::string len_str = str.substr(pos, len_end - pos);
-            try {
-                length = std::stoi(len_str);
-            } catch (const std::exception&) {
-                return false;
-            }
-            
-            // 移动到类型字段
-            pos = len_end + gap.size();
-            size_t type_end = str.find(gap, pos);
-            if (type_end == std::string::npos) {
-                return false;
-            }
-            
-            std::string type_str = str.substr(pos, type_end - pos);
-            if (type_str == "PB") {
-                type = ProtocolType::PROTOBUF;
-            } else if (type_str == "JS") {
-                type = ProtocolType::JSON;
-            } else {
-                return false;
-            }
-            
-            // 解析数据字段
-            pos = type_end + gap.size();
-            if (pos + length + gap.size() > str.size()) {
-                return false;
-            }
-            
-            data = str.substr(pos, length);
-            
-            // 验证结束分隔符
-            if (str.substr(pos + length, gap.size()) != gap) {
-                return false;
-            }
-            
-            return true;
+            size_t message_end;
+            return parse_message(str.data(), str.size(), *this, message_end) == ParseResult::OK;
         }
     };
 
@@ -110,44 +219,60 @@ public:
     // 序列化接口
     static bool serialize(const Json::Value& val, std::string* data);
     static bool serialize(const google::protobuf::Message& msg, std::string* data);
-    
+
     // 反序列化接口
     static bool deserialize(const char* data, size_t len, Json::Value* val);
     static bool deserialize(const char* data, size_t len, google::protobuf::Message* msg);
-    
+    // 从切片链中解析, 数据不连续时逐段读取, 不先拼接
+    static bool deserialize(const net::IOBuf& buf, google::protobuf::Message* msg);
+
     // 协议打包接口
     static bool pack_protobuf(const google::protobuf::Message& msg, std::string* packed_data);
     static bool pack_json(const Json::Value& json, std::string* packed_data);
     static bool pack(const LVProtocol& protocol, std::string* packed_data);
-    
+
     // 协议解析接口（解决粘包问题）
     static bool unpack(const char* data, size_t len, std::vector<LVProtocol>& messages);
     static bool unpack(const std::string& data, std::vector<LVProtocol>& messages);
-    
+
+    // 从 data 开头解析一条完整帧, 成功时 frame_end 为该帧占用的字节数
+    // 根据首字节自动识别二进制帧和旧版文本帧
+    static ParseResult parse_frame(const char* data, size_t len,
+        FrameView& frame, size_t& frame_end);
+
+    // 同 parse_frame, 但将消息体拷贝到 message 中
+    static ParseResult parse_message(const char* data, size_t len,
+        LVProtocol& message, size_t& message_end);
+
     // 缓冲区处理（用于处理不完整的数据包）
     class BufferHandler {
     public:
         BufferHandler() : buffer_("") {}
-        
+
         // 添加新数据并尝试解析完整消息
         void append(const char* data, size_t len);
         void append(const std::string& data);
-        
+
         // 获取解析出的完整消息
         bool get_next_message(LVProtocol& message);
-        
+
+        // 获取下一帧的视图, 视图在下一次 append 之前有效
+        bool next_frame(FrameView& frame);
+
         // 获取剩余缓冲区大小
-        size_t remaining_size() const { return buffer_.size(); }
-        
+        size_t remaining_size() const { return buffer_.size() - read_pos_; }
+
         // 清空缓冲区
-        void clear() { buffer_.clear(); }
-        
+        void clear() { buffer_.clear(); read_pos_ = 0; }
+
     private:
         std::string buffer_;
+        // 已消费数据的偏移, 只在追加数据时按需整理, 避免每条消息都 erase
+        size_t read_pos_{ 0 };
     };
 
 private:
     // 内部辅助方法
-    static bool find_complete_message(const std::string& data, size_t& message_end);
-    static bool parse_message_header(const std::string& data, size_t& data_start, int& length, ProtocolType& type);
-};
\ No newline at end of file
+    static ParseResult parse_message_header(const char* data, size_t len,
+        size_t& data_start, int& length, ProtocolType& type);
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "channel.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace net
+{
+
+// 一个方法的重试策略
+// 调用以 retry_on 中的状态结束时, 按指数退避加随机抖动等待后换一个节点重试, 最多共尝试 max_attempts 次;
+// 退避后会越过截止时间或服务的重试预算不足时不再重试, 直接返回最后一次的结果
+struct RetryPolicy
+{
+    int max_attempts = 1; // 包括第一次调用, 1 表示不重试
+    // 默认只重试服务端明确没有处理的请求; CONNECTION_CLOSED 时请求可能已经执行, 只应对幂等的方法开启
+    std::vector<RpcStatus> retry_on{ RpcStatus::OVERLOADED, RpcStatus::NO_ENDPOINT };
+    std::chrono::milliseconds initial_backoff{ 10 };
+    std::chrono::milliseconds max_backoff{ 1000 };
+    double multiplier = 2.0;
+
+    bool retryable(RpcStatus status) const;
+    // 第 attempt 次尝试失败后的等待时间: 在 [0, min(max_backoff, initial_backoff * multiplier^(attempt-1))] 中均匀取值,
+    // 避免同时失败的调用方在同一时刻一起重试
+    std::chrono::milliseconds backoff(int attempt) const;
+};
+
+// 一个服务的重试预算, 令牌桶
+// 每个请求存入 ratio 个令牌, 每次重试取出一个, 令牌最多积累 max_tokens 个;
+// 稳定状态下重试数不超过请求数的 ratio 倍, 节点大面积故障时重试不会成倍放大流量
+class RetryBudget
+{
+public:
+    explicit RetryBudget(double ratio = 0.1, double max_tokens = 10);
+
+    RetryBudget(const RetryBudget&) = delete;
+    RetryBudget& operator=(const RetryBudget&) = delete;
+
+    // 记一次请求, 存入令牌
+    void deposit();
+    // 令牌足够时取出一个并返回 true, 否则记一次拒绝并返回 false
+    bool try_withdraw();
+
+    double tokens() const { return static_cast<double>(tokens_.load(std::memory_order_relaxed)) / SCALE; }
+    uint64_t retries() const { return retries_.load(std::memory_order_relaxed); }
+    uint64_t rejected() const { return rejected_.load(std::memory_order_relaxed); }
+
+private:
+    // 令牌以千分之一为单位存成整数, 用 CAS 更新
+    static constexpr int64_t SCALE = 1000;
+
+    const int64_t deposit_;
+    const int64_t max_;
+    std::atomic<int64_t> tokens_;
+    std::atomic<uint64_t> retries_{ 0 };
+    std::atomic<uint64_t> rejected_{ 0 };
+};
+
+} // namespace net
@@ -1,22 +1,100 @@
 #pragma once
 
+#include "channel.h"
 #include "net.h"
 #include "protocol.h"
+#include "executor.h"
+#include "local_registry.h"
 #include <google/protobuf/message.h>
 #include <functional>
 #include <memory>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <pthread.h>
 
 
 namespace net {
 
+// 异步处理完成的回调: ok 表示处理是否成功, body 为序列化后的响应体
+using HandleDone = std::function<void(bool ok, std::string body)>;
+
 // 通用的消息处理器接口
 class IMessageHandler {
 public:
     virtual ~IMessageHandler() = default;
-    virtual bool handle(const std::string& data, Buffer* response) = 0;
+    // 处理请求体, 成功时将序列化后的响应体写入 response, 由调用方负责封帧
+    // data 指向接收缓冲区, 只在本次调用期间有效
+    virtual bool handle(std::string_view data, std::string* response) = 0;
     virtual ProtocolType get_type() const = 0;
+
+    // 以帧为单位处理请求, 响应体追加到 response 中; 默认转调 handle
+    // 响应可以通过 request.share_body() 等方式直接引用已有的块, 发送时不再拷贝
+    virtual bool handle_frame(const FrameView& request, IOBuf* response) {
+        std::string body;
+        if (!handle(request.body, &body)) {
+            return false;
+        }
+        response->append(std::move(body));
+        return true;
+    }
+
+    // 协程处理器返回 true, Provider 改为调用 handle_async
+    virtual bool is_async() const { return false; }
+
+    // 同步解析请求后在 ex 上启动协程, 协程完成时回调 done; deadline 为请求的截止时间
+    // 返回 false 表示请求解析失败, 此时不会回调 done
+    virtual bool handle_async(std::string_view data, Deadline deadline, const asio::any_io_executor& /*ex*/,
+                              HandleDone done) {
+        DeadlineScope scope(deadline);
+        std::string body;
+        if (!handle(data, &body)) {
+            return false;
+        }
+        done(true, std::move(body));
+        return true;
+    }
+
+    // 进程内调用: 请求和响应的消息类型与处理器一致时返回 true, 此后可以直接以消息调用 handle_local
+    // 返回 false 的处理器由调用方序列化请求后经 handle_frame 或 handle_async 调用
+    virtual bool supports_local(const google::protobuf::Descriptor*, const google::protobuf::Descriptor*) const {
+        return false;
+    }
+
+    // 以调用方的消息直接处理请求, 不经过序列化; 返回处理是否成功
+    virtual bool handle_local(const google::protobuf::Message&, google::protobuf::Message*) {
+        return false;
+    }
+
+    // 协程处理器的进程内调用, 协程在调用方的执行器上运行
+    virtual asio::awaitable<bool> handle_local_async(const google::protobuf::Message& request,
+                                                     google::protobuf::Message* response, Deadline deadline) {
+        DeadlineScope scope(deadline);
+        co_return handle_local(request, response);
+    }
 };
 
+// 把调用方的消息转换为处理器的消息类型
+// 类型相同时直接返回原消息, 只有描述符相同时 (例如调用方使用动态消息) 经 CopyFrom 拷贝到 copy 中
+template <typename MessageType>
+const MessageType* local_message(const google::protobuf::Message& message, MessageType& copy) {
+    if (auto typed = dynamic_cast<const MessageType*>(&message)) {
+        return typed;
+    }
+    copy.CopyFrom(message);
+    return &copy;
+}
+
+// 把处理器产生的响应交给调用方, 类型相同时移动, 否则经 CopyFrom 拷贝
+template <typename MessageType>
+void local_response(MessageType& response, google::protobuf::Message* target) {
+    if (auto typed = dynamic_cast<MessageType*>(target)) {
+        *typed = std::move(response);
+    } else {
+        target->CopyFrom(response);
+    }
+}
+
 // Protobuf 消息处理器
 template<typename RequestType, typename ResponseType = google::protobuf::Message>
 class ProtobufMessageHandler : public IMessageHandler {
@@ -25,9 +103,9 @@ public:
     
     ProtobufMessageHandler(HandlerFunc handler) : handler_(std::move(handler)) {}
     
-    bool handle(const std::string& data, Buffer* response) override {
+    bool handle(std::string_view data, std::string* response) override {
         RequestType request;
-        if (!request.ParseFromString(data)) {
+        if (!request.ParseFromArray(data.data(), static_cast<int>(data.size()))) {
             ERR("Failed to parse protobuf message");
             return false;
         }
@@ -37,12 +115,9 @@ public:
             handler_(request, response_msg);
             
             // 序列化响应
-            if (response) {
-                std::string serialized;
-                if (response_msg.SerializeToString(&serialized)) {
-                    ProtocolTools::LVProtocol protocol(ProtocolType::PROTOBUF, serialized);
-                    response->append(protocol.to_string());
-                }
+            if (response && !response_msg.SerializeToString(response)) {
+                ERR("Failed to serialize protobuf response");
+                return false;
             }
             return true;
         } catch (const std::exception& e) {
@@ -54,11 +129,114 @@ public:
     ProtocolType get_type() const override {
         return ProtocolType::PROTOBUF;
     }
+
+    bool supports_local(const google::protobuf::Descriptor* request,
+                        const google::protobuf::Descriptor* response) const override {
+        return request == RequestType::descriptor() && response == ResponseType::descriptor();
+    }
+
+    bool handle_local(const google::protobuf::Message& request, google::protobuf::Message* response) override {
+        RequestType request_copy;
+        const RequestType* typed = local_message(request, request_copy);
+        try {
+            // 调用方的响应类型与处理器一致时直接写入, 省去一次移动
+            if (auto typed_response = dynamic_cast<ResponseType*>(response)) {
+                handler_(*typed, *typed_response);
+                return true;
+            }
+            ResponseType response_msg;
+            handler_(*typed, response_msg);
+            local_response(response_msg, response);
+            return true;
+        } catch (const std::exception& e) {
+            ERR("Protobuf handler error: {}", e.what());
+            return false;
+        }
+    }
     
 private:
     HandlerFunc handler_;
 };
 
+// 协程 Protobuf 消息处理器
+// 处理器返回 asio::awaitable<ResponseType>, 可以在其中 co_await 下游调用或其他异步操作,
+// 挂起期间 io 线程继续服务其他会话, 协程完成后再发送响应
+// 协程挂起后 current_deadline() 不再有效, 需要请求截止时间的处理器使用 DeadlineHandlerFunc 从参数中取得
+template<typename RequestType, typename ResponseType>
+class AsyncProtobufMessageHandler : public IMessageHandler {
+public:
+    using HandlerFunc = std::function<asio::awaitable<ResponseType>(const RequestType&)>;
+    // 额外接收请求的截止时间, 以它发起下游调用即可继承调用方剩余的时间
+    using DeadlineHandlerFunc = std::function<asio::awaitable<ResponseType>(const RequestType&, Deadline)>;
+
+    AsyncProtobufMessageHandler(HandlerFunc handler) :
+        handler_([handler = std::move(handler)](const RequestType& request, Deadline) { return handler(request); }) {}
+    AsyncProtobufMessageHandler(DeadlineHandlerFunc handler) : handler_(std::move(handler)) {}
+
+    // 协程处理器不支持同步调用
+    bool handle(std::string_view, std::string*) override {
+        return false;
+    }
+
+    ProtocolType get_type() const override {
+        return ProtocolType::PROTOBUF;
+    }
+
+    bool is_async() const override {
+        return true;
+    }
+
+    bool handle_async(std::string_view data, Deadline deadline, const asio::any_io_executor& ex,
+                      HandleDone done) override {
+        RequestType request;
+        if (!request.ParseFromArray(data.data(), static_cast<int>(data.size()))) {
+            ERR("Failed to parse protobuf message");
+            return false;
+        }
+
+        asio::co_spawn(ex, run(std::move(request), deadline, std::move(done)), asio::detached);
+        return true;
+    }
+
+    bool supports_local(const google::protobuf::Descriptor* request,
+                        const google::protobuf::Descriptor* response) const override {
+        return request == RequestType::descriptor() && response == ResponseType::descriptor();
+    }
+
+    asio::awaitable<bool> handle_local_async(const google::protobuf::Message& request,
+                                             google::protobuf::Message* response, Deadline deadline) override {
+        RequestType request_copy;
+        const RequestType* typed = local_message(request, request_copy);
+        try {
+            ResponseType response_msg = co_await handler_(*typed, deadline);
+            local_response(response_msg, response);
+            co_return true;
+        } catch (const std::exception& e) {
+            ERR("Protobuf handler error: {}", e.what());
+            co_return false;
+        }
+    }
+
+private:
+    // 请求保存在协程帧中, 在整个处理期间保持有效
+    asio::awaitable<void> run(RequestType request, Deadline deadline, HandleDone done) {
+        std::string body;
+        bool ok = false;
+        try {
+            ResponseType response = co_await handler_(request, deadline);
+            ok = response.SerializeToString(&body);
+            if (!ok) {
+                ERR("Failed to serialize protobuf response");
+            }
+        } catch (const std::exception& e) {
+            ERR("Protobuf handler error: {}", e.what());
+        }
+        done(ok, std::move(body));
+    }
+
+    DeadlineHandlerFunc handler_;
+};
+
 // JSON 消息处理器
 class JsonMessageHandler : public IMessageHandler {
 public:
@@ -66,9 +244,9 @@ public:
     
     JsonMessageHandler(HandlerFunc handler) : handler_(std::move(handler)) {}
     
-    bool handle(const std::string& data, Buffer* response) override {
+    bool handle(std::string_view data, std::string* response) override {
         Json::Value request;
-        if (!ProtocolTools::deserialize(data.c_str(), data.size(), &request)) {
+        if (!ProtocolTools::deserialize(data.data(), data.size(), &request)) {
             ERR("Failed to parse JSON message");
             return false;
         }
@@ -78,11 +256,9 @@ public:
             handler_(request, response_msg);
             
             // 序列化响应
-            if (response) {
-                std::string serialized;
-                ProtocolTools::serialize(response_msg, &serialized);
-                ProtocolTools::LVProtocol protocol(ProtocolType::JSON, serialized);
-                response->append(protocol.to_string());
+            if (response && !ProtocolTools::serialize(response_msg, response)) {
+                ERR("Failed to serialize JSON response");
+                return false;
             }
             return true;
         } catch (const std::exception& e) {
@@ -99,108 +275,749 @@ private:
     HandlerFunc handler_;
 };
 
+// 原始字节处理器, 不做反序列化, 直接读写请求和响应的切片
+// 适合转发、回显或携带大附件的场景, 例如原样回显请求体而不拷贝:
+//     [](const FrameView& req, IOBuf* rsp) { rsp->append(req.share_body()); return true; }
+class RawMessageHandler : public IMessageHandler {
+public:
+    using HandlerFunc = std::function<bool(const FrameView&, IOBuf*)>;
+
+    RawMessageHandler(ProtocolType type, HandlerFunc handler) :
+        type_(type), handler_(std::move(handler)) {}
+
+    bool handle(std::string_view data, std::string* response) override {
+        FrameView request;
+        request.type = type_;
+        request.body = data;
+        IOBuf body;
+        if (!handle_frame(request, &body)) {
+            return false;
+        }
+        if (response) {
+            *response = body.to_string();
+        }
+        return true;
+    }
+
+    bool handle_frame(const FrameView& request, IOBuf* response) override {
+        try {
+            return handler_(request, response);
+        } catch (const std::exception& e) {
+            ERR("Raw handler error: {}", e.what());
+            return false;
+        }
+    }
+
+    ProtocolType get_type() const override {
+        return type_;
+    }
+
+private:
+    ProtocolType type_;
+    HandlerFunc handler_;
+};
+
+// Provider 的配置
+struct ProviderOptions
+{
+    // io 线程数, 0 表示每个 CPU 核心一个线程
+    // 每个线程拥有独立的 io_context 和监听套接字, 多个监听套接字通过 SO_REUSEPORT
+    // 绑定同一端口, 由内核把新连接分散到各个线程, 会话始终留在接受它的线程上
+    size_t io_threads = 1;
+    // 是否将第 i 个 io 线程绑定到第 i 个 CPU 核心
+    bool pin_threads = false;
+    // ExecMode::POOL 处理器共享的工作线程数, 0 表示每个 CPU 核心一个线程
+    size_t worker_threads = 0;
+    // 每个 ExecMode::DEDICATED 处理器独占的线程数
+    size_t dedicated_threads = 1;
+    // 套接字读写使用的内核接口, io_uring 不可用时退回 epoll
+    Transport transport = Transport::EPOLL;
+    UringOptions uring;
+    // 非空时同时在该路径的 Unix 域套接字上监听, 供同主机的调用方绕过 TCP/IP 协议栈
+    // 同一路径只能有一个监听套接字, 这些连接由第一个 io 线程处理
+    std::string unix_path;
+    // 是否接受同主机客户端切换到共享内存传输的请求, 以及服务端轮询线程的自旋时长
+    bool accept_shm = true;
+    ShmOptions shm;
+    // 每个会话的流量控制参数
+    SessionLimits limits;
+    // 所有会话的接收缓冲区、处理中的请求和待发送的响应共享的内存预算, 单位字节, 0 表示不限制
+    // 用量达到上限后新请求不再解析, 直接以 OVERLOADED 响应
+    size_t memory_budget = 0;
+    // 非空时在 start 后以该服务名登记到进程内的服务表, 同进程中经 ChannelPool 调用该服务的请求
+    // 直接交给这里的处理器, 不经过套接字, 见 call_local
+    std::string service;
+};
+
 class Provider {
 public:
-    Provider(int port) : 
-        server_(std::make_shared<Server>(ioc_, port, [this](Buffer& recv, Buffer* send) { 
-            this->service(recv, send); 
-        })),
-        work_(ioc_)
-    {}
+    Provider(int port, ProviderOptions options = {}) : 
+        port_(port),
+        options_(options),
+        budget_(std::make_shared<MemoryBudget>(options_.memory_budget))
+    {
+        size_t threads = options_.io_threads;
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        auto cb = [this](const SessionPtr& session, Buffer& recv, WriteBatch* send) {
+            this->service(session, recv, send);
+        };
+        for (size_t i = 0; i < threads; ++i) {
+            auto worker = std::make_unique<IoWorker>();
+            if (options_.transport == Transport::IO_URING && !enable_io_uring(worker->ioc, options_.uring)) {
+                options_.transport = Transport::EPOLL;
+            }
+            worker->server = std::make_shared<Server>(worker->ioc, port, cb, threads > 1);
+            worker->server->set_session_limits(options_.limits);
+            worker->server->set_memory_budget(budget_);
+            workers_.push_back(std::move(worker));
+        }
+        if (!options_.unix_path.empty()) {
+            workers_[0]->unix_server = std::make_shared<Server>(workers_[0]->ioc, options_.unix_path, cb);
+            workers_[0]->unix_server->set_session_limits(options_.limits);
+            workers_[0]->unix_server->set_memory_budget(budget_);
+        }
+    }
+
+    // 注册到服务发现的地址列表: host:port, 配置了 Unix 域套接字时附带其地址
+    // 同主机的调用方据此改走 Unix 域套接字, 见 select_endpoint
+    std::string advertised_endpoint(const std::string& host) const {
+        std::string endpoint = host + ":" + std::to_string(port_);
+        if (!options_.unix_path.empty()) {
+            endpoint += "," + std::string(UNIX_ENDPOINT_PREFIX) + options_.unix_path;
+        }
+        return endpoint;
+    }
+
+    ~Provider() { stop(); }
+
+    // 内存预算的当前用量和拒绝次数
+    const MemoryBudget& memory() const { return *budget_; }
+    // 因超过调用方的截止时间而未处理的请求数
+    uint64_t expired_requests() const { return expired_.load(std::memory_order_relaxed); }
 
     // 注册 Protobuf 消息处理器
+    // mode 指定处理器的执行位置, 耗时的处理器应放到工作线程中, 避免阻塞同一 io 线程上的其他会话
+    template<typename RequestType, typename ResponseType = google::protobuf::Message>
+    void register_protobuf_handler(typename ProtobufMessageHandler<RequestType, ResponseType>::HandlerFunc handler,
+                                   ExecMode mode = ExecMode::INLINE) {
+        register_protobuf_handler<RequestType, ResponseType>("", std::move(handler), mode);
+    }
+
+    // 注册指定方法名的 Protobuf 消息处理器, 携带方法名的请求直接路由到对应处理器
     template<typename RequestType, typename ResponseType = google::protobuf::Message>
-    void register_protobuf_handler(typename ProtobufMessageHandler<RequestType, ResponseType>::HandlerFunc handler) {
+    void register_protobuf_handler(const std::string& method,
+                                   typename ProtobufMessageHandler<RequestType, ResponseType>::HandlerFunc handler,
+                                   ExecMode mode = ExecMode::INLINE) {
         auto handler_ptr = std::make_shared<ProtobufMessageHandler<RequestType, ResponseType>>(std::move(handler));
-        handlers_.push_back(handler_ptr);
-        INF("Registered protobuf handler for type: {}", typeid(RequestType).name());
+        add_handler(method, handler_ptr, mode, typeid(RequestType).name());
+        INF("Registered protobuf handler for type: {}, method: {}", typeid(RequestType).name(), method);
+    }
+
+    // 注册协程 Protobuf 消息处理器, 协程在请求所属会话的 io 线程上执行:
+    //     provider.register_protobuf_handler<AddRequest, AddResponse>("Add",
+    //         [](const AddRequest& req) -> asio::awaitable<AddResponse> { ... co_return rsp; });
+    template<typename RequestType, typename ResponseType>
+    void register_protobuf_handler(typename AsyncProtobufMessageHandler<RequestType, ResponseType>::HandlerFunc handler) {
+        register_protobuf_handler<RequestType, ResponseType>("", std::move(handler));
+    }
+
+    template<typename RequestType, typename ResponseType>
+    void register_protobuf_handler(const std::string& method,
+                                   typename AsyncProtobufMessageHandler<RequestType, ResponseType>::HandlerFunc handler) {
+        auto handler_ptr = std::make_shared<AsyncProtobufMessageHandler<RequestType, ResponseType>>(std::move(handler));
+        add_handler(method, handler_ptr, ExecMode::INLINE, typeid(RequestType).name());
+        INF("Registered async protobuf handler for type: {}, method: {}", typeid(RequestType).name(), method);
+    }
+
+    // 注册接收请求截止时间的协程处理器, 下游调用以它作为截止时间即可继承调用方剩余的时间:
+    //     provider.register_protobuf_handler<AddRequest, AddResponse>("Proxy",
+    //         [](const AddRequest& req, net::Deadline deadline) -> asio::awaitable<AddResponse> {
+    //             auto result = co_await channel->call<AddRequest, AddResponse>("Add", req, deadline); ... });
+    template<typename RequestType, typename ResponseType>
+    void register_protobuf_handler(
+        typename AsyncProtobufMessageHandler<RequestType, ResponseType>::DeadlineHandlerFunc handler) {
+        register_protobuf_handler<RequestType, ResponseType>("", std::move(handler));
+    }
+
+    template<typename RequestType, typename ResponseType>
+    void register_protobuf_handler(const std::string& method,
+        typename AsyncProtobufMessageHandler<RequestType, ResponseType>::DeadlineHandlerFunc handler) {
+        auto handler_ptr = std::make_shared<AsyncProtobufMessageHandler<RequestType, ResponseType>>(std::move(handler));
+        add_handler(method, handler_ptr, ExecMode::INLINE, typeid(RequestType).name());
+        INF("Registered async protobuf handler for type: {}, method: {}", typeid(RequestType).name(), method);
     }
 
     // 注册 JSON 消息处理器
-    void register_json_handler(JsonMessageHandler::HandlerFunc handler) {
+    void register_json_handler(JsonMessageHandler::HandlerFunc handler, ExecMode mode = ExecMode::INLINE) {
+        register_json_handler("", std::move(handler), mode);
+    }
+
+    void register_json_handler(const std::string& method, JsonMessageHandler::HandlerFunc handler,
+                               ExecMode mode = ExecMode::INLINE) {
         auto handler_ptr = std::make_shared<JsonMessageHandler>(std::move(handler));
-        handlers_.push_back(handler_ptr);
-        INF("Registered JSON handler");
+        add_handler(method, handler_ptr, mode, "json");
+        INF("Registered JSON handler, method: {}", method);
     }
 
+    // 注册原始字节处理器, 只按方法名路由
+    void register_raw_handler(const std::string& method, RawMessageHandler::HandlerFunc handler,
+                              ProtocolType type = ProtocolType::PROTOBUF, ExecMode mode = ExecMode::INLINE) {
+        auto handler_ptr = std::make_shared<RawMessageHandler>(type, std::move(handler));
+        add_handler(method, handler_ptr, mode, "raw");
+        INF("Registered raw handler, method: {}", method);
+    }
+
+    // 处理器需要在 start 之前注册完成, 运行期间各 io 线程只读访问处理器列表
     void start() {
-        server_->start();
-        std::thread([this]() {
-            ioc_.run();
-        }).detach();
+        for (size_t i = 0; i < workers_.size(); ++i) {
+            IoWorker* worker = workers_[i].get();
+            worker->server->start();
+            if (worker->unix_server) {
+                worker->unix_server->start();
+            }
+            worker->thread = std::thread([worker]() {
+                worker->ioc.run();
+            });
+            if (options_.pin_threads) {
+                pin_thread(worker->thread, i);
+            }
+        }
+        if (!options_.service.empty()) {
+            std::unordered_map<std::string, LocalMethod> methods;
+            for (const auto& [method, index] : methods_) {
+                methods[method] = LocalMethod{ handlers_[index].handler, handlers_[index].executor };
+            }
+            LocalRegistry::instance().add(options_.service, this, std::move(methods));
+        }
+        INF("Provider started with {} io threads", workers_.size());
     }
 
     void stop() {
-        server_->stop();
-        ioc_.stop();
-        INF("Provider stopped");
+        // 先停止接收新连接和进程内调用, 再等待执行器中的任务完成, 最后停止 io 线程
+        if (!options_.service.empty()) {
+            LocalRegistry::instance().remove(options_.service, this);
+        }
+        for (auto& worker : workers_) {
+            worker->server->stop();
+            if (worker->unix_server) {
+                worker->unix_server->stop();
+            }
+        }
+        for (auto& executor : executors_) {
+            executor->stop();
+        }
+
+        bool running = false;
+        for (auto& worker : workers_) {
+            worker->work.reset();
+            worker->ioc.stop();
+            if (worker->thread.joinable()) {
+                worker->thread.join();
+                running = true;
+            }
+        }
+        if (running) {
+            INF("Provider stopped");
+        }
     }
 
 private:
-    void service(Buffer& recv, Buffer* send) {
-        // 解析读取的数据
-        std::string data = recv.read_all_as_string();
-        INF("收到了 {} 字节的数据", data.size());
+    void service(const SessionPtr& session, Buffer& recv, WriteBatch* send) {
+        INF("收到了 {} 字节的数据", recv.readable_size());
 
-        static ProtocolTools::BufferHandler buffer_handler;
-        buffer_handler.append(data.data(), data.size());
-        
-        ProtocolTools::LVProtocol message;
-        while (buffer_handler.get_next_message(message)) {
-            handle_single_message(message, send);
+        // 直接在接收缓冲区上原地解析, 每个会话的半包数据留在各自的缓冲区中
+        // 帧视图指向 recv, 全部处理完后再一次性消费
+        FrameDecoder decoder(recv.read_data(), recv.readable_size());
+        FrameView frame;
+        ParseResult res = ParseResult::INCOMPLETE;
+        // 会话过载时停止解析, 其余的帧等会话恢复读取后再处理
+        while (!session->overloaded() && (res = decoder.next(frame)) == ParseResult::OK) {
+            frame.block = recv.block();
+            handle_single_message(session, frame, send);
+        }
+
+        if (res == ParseResult::INVALID) {
+            ERR("Invalid frame, drop {} bytes", recv.readable_size());
+            recv.clear();
+            return;
         }
+        recv.advance_read(decoder.consumed());
     }
 
-    void handle_single_message(const ProtocolTools::LVProtocol& message, Buffer* send) {
-        INF("处理消息, 类型: {}, 长度: {}", 
+    void handle_single_message(const SessionPtr& session, const FrameView& message, WriteBatch* send) {
+        INF("处理消息, 类型: {}, 方法: {}, 长度: {}", 
             (message.type == ProtocolType::PROTOBUF ? "Protobuf" : "JSON"), 
-            message.length);
-
-        // 尝试所有注册的处理器
-        bool handled = false;
-        for (const auto& handler : handlers_) {
-            if (handler->get_type() == message.type) {
-                if (handler->handle(message.data, send)) {
-                    handled = true;
-                    break;
-                }
+            message.method, message.body.size());
+
+        if (message.flags & FLAG_CONTROL) {
+            handle_control(session, message, send);
+            return;
+        }
+
+        // 调用方已经放弃的请求不再解析和分发, 也不回复
+        Deadline deadline = deadline_of(session, message);
+        if (expired(deadline)) {
+            return;
+        }
+
+        // 预算耗尽时不解析请求体, 只回一个不带消息体的帧头
+        if (budget_->exhausted()) {
+            budget_->reject();
+            reply(message, message.type, IOBuf(), send, StatusCode::OVERLOADED);
+            return;
+        }
+
+        // 携带方法名的请求直接路由
+        if (!message.method.empty()) {
+            auto it = methods_.find(std::string(message.method));
+            if (it == methods_.end()) {
+                ERR("No handler found for method: {}", message.method);
+                send_error_response(message, "No handler found", StatusCode::NO_HANDLER, send);
+                return;
             }
+            if (!invoke(session, message, it->second, deadline, send)) {
+                send_error_response(message, "Handler failed", StatusCode::HANDLER_ERROR, send);
+            }
+            return;
         }
 
-        if (!handled) {
-            ERR("No suitable handler found for message type: {}", 
-                (message.type == ProtocolType::PROTOBUF ? "Protobuf" : "JSON"));
-            // 可以发送错误响应
-            send_error_response(message.type, "No handler found", send);
+        try_handlers(session, message, 0, deadline, send);
+    }
+
+    // 请求的截止时间, 剩余时间从会话读到该帧的时刻开始计算; 未携带剩余时间时为 Deadline::max()
+    static Deadline deadline_of(const SessionPtr& session, const FrameView& message) {
+        if (!message.timeout_ms) {
+            return Deadline::max();
         }
+        return session->received_at() + std::chrono::milliseconds(message.timeout_ms);
     }
 
-    void send_error_response(ProtocolType type, const std::string& error_msg, Buffer* send) {
-        if (!send) return;
+    // 请求已经超过截止时间时计数并返回 true
+    bool expired(Deadline deadline) {
+        if (deadline == Deadline::max() || Deadline::clock::now() < deadline) {
+            return false;
+        }
+        expired_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
 
-        if (type == ProtocolType::JSON) {
-            Json::Value error_response;
-            error_response["status"] = "error";
-            error_response["message"] = error_msg;
-            error_response["timestamp"] = static_cast<Json::Int64>(time(nullptr));
-            
-            std::string serialized;
-            ProtocolTools::serialize(error_response, &serialized);
-            ProtocolTools::LVProtocol protocol(ProtocolType::JSON, serialized);
-            send->append(protocol.to_string());
+    // 传输层的控制帧: 心跳和切换到共享内存的请求
+    // 映射成功后的响应已经经由共享内存发出, 客户端收到后再切换自己的发送
+    void handle_control(const SessionPtr& session, const FrameView& message, WriteBatch* send) {
+        if (message.method == PING_METHOD) {
+            reply(message, message.type, IOBuf(), send);
+            return;
+        }
+        if (message.method == SHM_ATTACH_METHOD) {
+            bool ok = options_.accept_shm && session->attach_shm(std::string(message.body), options_.shm);
+            reply(message, message.type, IOBuf(), send, ok ? StatusCode::OK : StatusCode::HANDLER_ERROR);
+            return;
+        }
+        ERR("Unknown control frame: {}", message.method);
+        send_error_response(message, "Unknown control frame", StatusCode::NO_HANDLER, send);
+    }
+
+    // 未指定方法名时, 从第 first 个处理器开始依次尝试类型匹配的处理器
+    void try_handlers(const SessionPtr& session, const FrameView& message, size_t first, Deadline deadline,
+                      WriteBatch* send) {
+        for (size_t i = first; i < handlers_.size(); ++i) {
+            if (handlers_[i].handler->get_type() != message.type) {
+                continue;
+            }
+            if (invoke(session, message, i, deadline, send)) {
+                return;
+            }
+        }
+
+        ERR("No suitable handler found for message type: {}", 
+            (message.type == ProtocolType::PROTOBUF ? "Protobuf" : "JSON"));
+        // 可以发送错误响应
+        send_error_response(message, "No handler found", StatusCode::NO_HANDLER, send);
+    }
+
+    // 执行第 index 个处理器, 同步产生的响应追加到 send 中
+    // 返回 false 表示处理器在当前线程中执行失败; 交给执行器的请求总是返回 true
+    // 同步执行的处理器可以通过 current_deadline() 取得 deadline, 协程处理器从参数中取得
+    bool invoke(const SessionPtr& session, const FrameView& message, size_t index, Deadline deadline,
+                WriteBatch* send) {
+        const HandlerEntry& entry = handlers_[index];
+
+        // 异步处理的请求在完成前一直占用内存, 先申请预算
+        size_t request_bytes = 0;
+        if (entry.handler->is_async() || entry.executor) {
+            request_bytes = message.body.size() + message.method.size() + sizeof(OwnedFrame);
+            if (!budget_->try_acquire(MemoryCategory::REQUEST, request_bytes)) {
+                reply(message, message.type, IOBuf(), send, StatusCode::OVERLOADED);
+                return true;
+            }
+        }
+
+        // 协程处理器在会话所在的 io 线程上运行, 完成后通过会话发送响应
+        if (entry.handler->is_async()) {
+            FrameView reply_to = message;
+            reply_to.method = std::string_view();
+            reply_to.body = std::string_view();
+            ProtocolType type = entry.handler->get_type();
+            // 处理可能在 handle_async 中同步完成, 先计入在途请求
+            session->request_started();
+            bool parsed = entry.handler->handle_async(message.body, deadline, session->get_executor(),
+                [this, session, reply_to, type, request_bytes](bool ok, std::string body) {
+                    budget_->sub(MemoryCategory::REQUEST, request_bytes);
+                    WriteBatch out;
+                    if (ok) {
+                        reply(reply_to, type, std::move(body), &out);
+                    } else {
+                        send_error_response(reply_to, "Handler failed", StatusCode::HANDLER_ERROR, &out);
+                    }
+                    session->finish_request(std::move(out));
+                });
+            if (!parsed) {
+                budget_->sub(MemoryCategory::REQUEST, request_bytes);
+                session->finish_request(IOBuf());
+            }
+            return parsed;
+        }
+
+        // 交给执行器, 请求体以切片的形式引用接收缓冲区, 不做拷贝
+        if (entry.executor) {
+            session->request_started();
+            auto request = std::make_shared<OwnedFrame>(message);
+            entry.executor->submit([this, session, request, index, deadline, request_bytes]() {
+                run_offloaded(session, request->frame, index, deadline);
+                budget_->sub(MemoryCategory::REQUEST, request_bytes);
+            });
+            return true;
+        }
+
+        IOBuf body;
+        DeadlineScope scope(deadline);
+        if (!entry.handler->handle_frame(message, &body)) {
+            return false;
+        }
+        reply(message, entry.handler->get_type(), std::move(body), send);
+        return true;
+    }
+
+    // 在执行器线程中运行第 index 个处理器, 在队列中等到超过截止时间的请求直接丢弃
+    // 完成的响应经会话的无锁队列交回其所在的 io 线程发送
+    void run_offloaded(const SessionPtr& session, const FrameView& message, size_t index, Deadline deadline) {
+        if (expired(deadline)) {
+            session->finish_request(IOBuf());
+            return;
+        }
+
+        WriteBatch out;
+        IOBuf body;
+        const HandlerEntry& entry = handlers_[index];
+        bool ok;
+        {
+            DeadlineScope scope(deadline);
+            ok = entry.handler->handle_frame(message, &body);
+        }
+        if (ok) {
+            reply(message, entry.handler->get_type(), std::move(body), &out);
+        } else if (!message.method.empty()) {
+            send_error_response(message, "Handler failed", StatusCode::HANDLER_ERROR, &out);
         } else {
-            // 对于 Protobuf，可以创建一个通用的错误消息类型
-            // 这里简单使用 JSON 作为错误响应
-            send_error_response(ProtocolType::JSON, error_msg, send);
+            try_handlers(session, message, index + 1, deadline, &out);
         }
+
+        session->finish_request(std::move(out));
     }
 
-private:
-    asio::io_context ioc_;
-    std::shared_ptr<Server> server_;
-    asio::io_context::work work_;
-    std::vector<std::shared_ptr<IMessageHandler>> handlers_;
+    // 响应沿用请求的协议版本和请求 id, 保证旧版文本协议的节点仍能正常通信
+    // 客户端按请求 id 匹配响应, 因此响应不必与请求保持相同顺序
+    // 二进制帧的帧头单独成段, 响应体的切片原样跟在后面, 由聚集写一并发出
+    void reply(const FrameView& request, ProtocolType type, IOBuf body,
+               WriteBatch* send, StatusCode status = StatusCode::OK) {
+        if (!send) return;
+
+        if (request.version == WireVersion::BINARY) {
+            FrameHeader header;
+            header.flags = FLAG_RESPONSE;
+            header.codec = type;
+            header.status = status;
+            header.request_id = request.request_id;
+            header.body_length = static_cast<uint32_t>(body.size());
+
+            std::string head(FrameHeader::SIZE, '\0');
+            header.encode(head.data());
+            send->append(std::move(head));
+            send->append(std::move(body));
+            return;
+        }
+
+        ProtocolTools::LVProtocol protocol(type, body.to_string());
+        protocol.version = request.version;
+        protocol.flags = FLAG_RESPONSE;
+        protocol.status = status;
+        protocol.request_id = request.request_id;
+        send->append(protocol.to_string());
+    }
+
+    void send_error_response(const FrameView& request, const std::string& error_msg,
+                             StatusCode status, WriteBatch* send) {
+        // 对于 Protobuf，可以创建一个通用的错误消息类型
+        // 这里统一使用 JSON 作为错误响应
+        Json::Value error_response;
+        error_response["status"] = "error";
+        error_response["message"] = error_msg;
+        error_response["timestamp"] = static_cast<Json::Int64>(time(nullptr));
+
+        std::string serialized;
+        ProtocolTools::serialize(error_response, &serialized);
+        reply(request, ProtocolType::JSON, std::move(serialized), send, status);
+    }
+
+    void add_handler(const std::string& method, std::shared_ptr<IMessageHandler> handler,
+                     ExecMode mode, const std::string& name) {
+        if (!method.empty()) {
+            if (methods_.count(method)) {
+                WAR("Handler for method {} already registered, overwrite it", method);
+            }
+            methods_[method] = handlers_.size();
+        }
+        handlers_.push_back({ std::move(handler), executor_for(mode, method.empty() ? name : method) });
+    }
+
+    // 根据执行方式获取处理器使用的执行器, INLINE 返回空
+    std::shared_ptr<IExecutor> executor_for(ExecMode mode, const std::string& name) {
+        switch (mode) {
+            case ExecMode::POOL:
+                if (!pool_) {
+                    pool_ = std::make_shared<WorkStealingPool>(options_.worker_threads, "pool");
+                    executors_.push_back(pool_);
+                }
+                return pool_;
+            case ExecMode::DEDICATED: {
+                auto executor = std::make_shared<WorkStealingPool>(options_.dedicated_threads, name);
+                executors_.push_back(executor);
+                return executor;
+            }
+            default:
+                return nullptr;
+        }
+    }
+
+    // 绑定线程到指定的 CPU 核心
+    static void pin_thread(std::thread& thread, size_t index) {
+        unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(index % cores, &cpuset);
+        int rc = pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpuset);
+        if (rc != 0) {
+            WAR("Failed to pin io thread {} to core {}: {}", index, index % cores, strerror(rc));
+        }
+    }
+
+    // 每个 io 线程独占的资源
+    struct IoWorker {
+        asio::io_context ioc{ 1 };
+        std::optional<asio::io_context::work> work{ ioc };
+        std::shared_ptr<Server> server;
+        std::shared_ptr<Server> unix_server; // 只在第一个 io 线程上
+        std::thread thread;
+    };
+
+    // 已注册的处理器及其执行器
+    struct HandlerEntry {
+        std::shared_ptr<IMessageHandler> handler;
+        std::shared_ptr<IExecutor> executor; // 为空表示在 io 线程中直接执行
+    };
+
+    // 交给执行器的请求, 持有请求体的切片, 接收缓冲区中的块在处理完之前不会被覆盖
+    // frame 的 method 和 body 指向自身持有的数据
+    struct OwnedFrame {
+        explicit OwnedFrame(const FrameView& view) :
+            frame(view), method(view.method), body(view.share_body()) {
+            frame.method = method;
+            frame.body = body.view();
+            frame.block = body.empty() ? nullptr : body.slices()[0].block;
+        }
+        OwnedFrame(const OwnedFrame&) = delete;
+
+        FrameView frame;
+        std::string method;
+        IOBuf body;
+    };
+
+    int port_;
+    ProviderOptions options_;
+    std::vector<std::unique_ptr<IoWorker>> workers_;
+    std::vector<HandlerEntry> handlers_;
+    // 方法名 -> handlers_ 中的下标
+    std::unordered_map<std::string, size_t> methods_;
+    std::shared_ptr<MemoryBudget> budget_;
+    std::atomic<uint64_t> expired_{ 0 };
+    std::shared_ptr<IExecutor> pool_;
+    std::vector<std::shared_ptr<IExecutor>> executors_;
 };
 
+// 等待在其他线程或协程中完成的进程内调用
+// start(done) 在当前执行器上发起操作, done 可在任意线程中以结果调用;
+// 到达 deadline 时以 TIMEOUT 结束, 之后的 done 被忽略. 协程总是在其自身的执行器上恢复.
+// 截止时间挂在当前 io_context 的时间轮上; 执行器不是 io_context 时没有时间轮可用, 改用一个 steady_timer
+template <typename Start>
+asio::awaitable<RpcStatus> await_local(Start start, Deadline deadline) {
+    auto ex = co_await asio::this_coro::executor;
+    auto initiation = [ex, deadline, start = std::move(start)](auto handler) mutable {
+        using Handler = decltype(handler);
+        struct State {
+            explicit State(Handler h) : handler(std::move(h)) {}
+            Handler handler;
+            std::atomic<bool> finished{ false };
+            // 以下只在 ex 上访问
+            asio::io_context* ioc = nullptr;
+            TimerId timer = 0;
+            std::optional<asio::steady_timer> fallback;
+        };
+        auto state = std::make_shared<State>(std::move(handler));
+        auto done = [state, ex](RpcStatus status) {
+            if (state->finished.exchange(true)) {
+                return;
+            }
+            asio::dispatch(ex, [state, status]() {
+                if (state->ioc) {
+                    timer_wheel(*state->ioc).cancel(state->timer);
+                } else if (state->fallback) {
+                    state->fallback->cancel();
+                }
+                state->handler(status);
+            });
+        };
+        if (deadline != Deadline::max()) {
+            // 发起操作时位于 ex 上, 可以直接访问其时间轮
+            if (auto* io = ex.template target<asio::io_context::executor_type>()) {
+                state->ioc = &io->context();
+                state->timer = timer_wheel(*state->ioc).add_at(deadline, [done]() { done(RpcStatus::TIMEOUT); });
+            } else {
+                state->fallback.emplace(ex, deadline);
+                state->fallback->async_wait([done](boost::system::error_code ec) {
+                    if (!ec) {
+                        done(RpcStatus::TIMEOUT);
+                    }
+                });
+            }
+        }
+        start(done);
+    };
+    co_return co_await asio::async_initiate<decltype(asio::use_awaitable), void(RpcStatus)>(
+        std::move(initiation), asio::use_awaitable);
+}
+
+// 进程内调用 LocalRegistry 中找到的处理器, 结果与经过网络的调用一致:
+// 登记了执行器的处理器在执行器中运行, 其余处理器在调用方的线程和执行器上运行, 超过 deadline 以 TIMEOUT 结束.
+// Protobuf 请求和响应的类型与处理器一致时以引用传递, 需要交给其他线程时按值拷贝请求, 都不做序列化;
+// 其他处理器 (JSON、原始字节或类型不一致) 序列化请求后直接调用, 同样不经过套接字
+template <typename RequestType, typename ResponseType>
+asio::awaitable<RpcResult<ResponseType>> call_local(LocalMethod local, std::string method,
+                                                   const RequestType& request, Deadline deadline) {
+    constexpr bool is_protobuf = std::is_base_of_v<google::protobuf::Message, RequestType> &&
+        std::is_base_of_v<google::protobuf::Message, ResponseType>;
+    auto status_of = [](bool ok) { return ok ? RpcStatus::OK : RpcStatus::HANDLER_ERROR; };
+
+    RpcResult<ResponseType> result;
+    if (Deadline::clock::now() >= deadline) {
+        result.status = RpcStatus::TIMEOUT;
+        co_return result;
+    }
+
+    std::shared_ptr<IMessageHandler> handler = local.handler;
+    std::shared_ptr<IExecutor> executor = local.executor;
+    auto ex = co_await asio::this_coro::executor;
+
+    if constexpr (is_protobuf) {
+        if (handler->supports_local(request.GetDescriptor(), result.response.GetDescriptor())) {
+            if (!executor && !handler->is_async()) {
+                DeadlineScope scope(deadline);
+                result.status = status_of(handler->handle_local(request, &result.response));
+            } else if (!executor && deadline == Deadline::max()) {
+                result.status = status_of(co_await handler->handle_local_async(request, &result.response, deadline));
+            } else {
+                // 交给其他线程或与截止时间竞争时, 请求和响应由共享状态持有, 超时返回后处理器仍可安全访问
+                auto req = std::make_shared<RequestType>(request);
+                auto rsp = std::make_shared<ResponseType>();
+                result.status = co_await await_local([&](auto done) {
+                    if (executor) {
+                        executor->submit([handler, req, rsp, done, status_of, deadline]() {
+                            DeadlineScope scope(deadline);
+                            done(status_of(handler->handle_local(*req, rsp.get())));
+                        });
+                        return;
+                    }
+                    asio::co_spawn(ex, handler->handle_local_async(*req, rsp.get(), deadline),
+                        [handler, req, rsp, done, status_of](std::exception_ptr e, bool ok) {
+                            done(status_of(!e && ok));
+                        });
+                }, deadline);
+                if (result.status == RpcStatus::OK) {
+                    result.response = std::move(*rsp);
+                }
+            }
+            if (result.status == RpcStatus::OK && Deadline::clock::now() > deadline) {
+                result.status = RpcStatus::TIMEOUT;
+            }
+            co_return result;
+        }
+    }
+
+    std::string body;
+    if (!ProtocolTools::serialize(request, &body)) {
+        result.status = RpcStatus::BAD_REQUEST;
+        co_return result;
+    }
+    ProtocolType type = is_protobuf ? ProtocolType::PROTOBUF : ProtocolType::JSON;
+
+    auto response = std::make_shared<std::string>();
+    if (!executor && !handler->is_async()) {
+        FrameView frame;
+        frame.type = type;
+        frame.method = method;
+        frame.body = body;
+        IOBuf out;
+        DeadlineScope scope(deadline);
+        result.status = status_of(handler->handle_frame(frame, &out));
+        *response = out.to_string();
+    } else {
+        auto req = std::make_shared<std::string>(std::move(body));
+        result.status = co_await await_local([&](auto done) {
+            if (executor) {
+                executor->submit([handler, req, response, method, type, done, status_of, deadline]() {
+                    DeadlineScope scope(deadline);
+                    FrameView frame;
+                    frame.type = type;
+                    frame.method = method;
+                    frame.body = *req;
+                    IOBuf out;
+                    bool ok = handler->handle_frame(frame, &out);
+                    *response = out.to_string();
+                    done(status_of(ok));
+                });
+                return;
+            }
+            bool parsed = handler->handle_async(*req, deadline, ex, [response, done, status_of](bool ok, std::string body) {
+                *response = std::move(body);
+                done(status_of(ok));
+            });
+            if (!parsed) {
+                done(RpcStatus::HANDLER_ERROR);
+            }
+        }, deadline);
+    }
+
+    if (result.status == RpcStatus::OK && Deadline::clock::now() > deadline) {
+        result.status = RpcStatus::TIMEOUT;
+    }
+    if (result.status == RpcStatus::OK &&
+        !ProtocolTools::deserialize(response->data(), response->size(), &result.response)) {
+        result.status = RpcStatus::BAD_RESPONSE;
+    }
+    co_return result;
+}
+
 } // namespace net
 
@@ -0,0 +1,171 @@
+#pragma once
+
+#include "iobuf.h"
+#include "log.h"
+#include <atomic>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace net
+{
+
+namespace asio = boost::asio;
+
+class Buffer;
+
+// 同主机客户端与服务端之间的共享内存传输
+// 客户端创建共享内存段, 通过已有的 TCP 连接发送控制帧告知段名, 服务端映射后两端改由段中的
+// 一对单生产者单消费者字节环收发数据; 环中传输的仍是与套接字相同的帧, 处理器感知不到差别.
+// TCP 连接继续保留, 用于握手和检测对端断开.
+// 每端在自己的 io 线程中轮询环, 空闲后登记睡眠并在一个抽象命名空间的 Unix 数据报套接字 (门铃) 上等待,
+// 对端只在发现本端登记了睡眠时才发一个字节唤醒, 连续收发时不经过任何系统调用
+
+// 请求服务端映射共享内存段的控制帧方法名, 消息体为段名
+inline constexpr const char SHM_ATTACH_METHOD[] = "__shm_attach";
+
+// 共享内存传输的配置
+struct ShmOptions
+{
+    // 每个方向的环的字节数, 取整到 2 的幂
+    size_t ring_size = 1 << 20;
+    // io 线程处理完数据后继续轮询环的时长, 之后登记睡眠等待门铃; 0 表示不轮询直接睡眠; 单核机器上总是不轮询
+    std::chrono::microseconds spin{ 50 };
+};
+
+// 映射到本进程的共享内存段, 布局为控制区 + 两个方向的环
+// 创建方为 0 号端, 从 0 号环写、1 号环读; 打开方为 1 号端, 方向相反
+class ShmSegment
+{
+public:
+    // 创建新的段, 段名随机生成
+    static std::unique_ptr<ShmSegment> create(size_t ring_size);
+    // 打开对端创建的段, 映射后立即删除名字, 段在双方都解除映射后释放
+    static std::unique_ptr<ShmSegment> open(const std::string& name);
+
+    ~ShmSegment();
+
+    ShmSegment(const ShmSegment&) = delete;
+    ShmSegment& operator=(const ShmSegment&) = delete;
+
+    const std::string& name() const { return name_; }
+    int side() const { return side_; }
+    // 第 side 端的门铃套接字在抽象命名空间中的地址, 由段名派生
+    std::string bell_address(int side) const;
+
+    // 以下为段内的共享结构, 只由 ShmStream 访问
+    struct Doorbell
+    {
+        alignas(64) std::atomic<uint32_t> sleeping; // 持有者已登记睡眠, 需要通过门铃套接字唤醒
+    };
+    struct Ring
+    {
+        alignas(64) std::atomic<uint64_t> head;  // 读端已消费的位置
+        alignas(64) std::atomic<uint64_t> tail;  // 写端已发布的位置
+        alignas(64) std::atomic<uint32_t> writer_blocked; // 写端因空间不足在等待
+    };
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t ring_size;
+        Doorbell bells[2]; // 第 i 个由第 i 端等待
+        Ring rings[2];     // 第 i 个由第 i 端写
+    };
+
+    Header* header() const { return header_; }
+    char* ring_data(int ring) const;
+    size_t ring_size() const { return ring_size_; }
+
+private:
+    ShmSegment() = default;
+
+    std::string name_;
+    int side_{ 0 };
+    bool owner_{ false };
+    void* addr_{ nullptr };
+    size_t length_{ 0 };
+    Header* header_{ nullptr };
+    size_t ring_size_{ 0 };
+};
+
+// 共享内存上的字节流, 用法与套接字一致: 收到的数据追加到自己的接收缓冲区并回调, 发送的数据整体写入环
+// 除构造外的所有操作都在 io 线程中执行, 没有额外的线程; 有数据可读或发送空间腾出时在 io 线程中直接处理.
+// 环满时剩余数据暂存, 由对端读走数据后的通知继续发送
+class ShmStream : public std::enable_shared_from_this<ShmStream>
+{
+public:
+    using DataCallback = std::function<void(Buffer& recv)>;
+
+    ShmStream(asio::io_context& ioc, std::unique_ptr<ShmSegment> segment,
+              const ShmOptions& options, DataCallback on_data);
+    ~ShmStream();
+
+    ShmStream(const ShmStream&) = delete;
+    ShmStream& operator=(const ShmStream&) = delete;
+
+    // 绑定本端的门铃并开始在 io 线程中轮询, 门铃绑定失败时返回 false
+    bool start();
+    // 发送数据, 只能在 io 线程中调用
+    void write(IOBuf data);
+    // 环满时暂存、尚未写入环的字节数
+    size_t pending_size() const { return pending_.size(); }
+    // 接收缓冲区占用的字节数
+    size_t recv_capacity() const;
+    // 暂存的数据继续写入环后回调, 在 io 线程中执行, 需在 start 之前设置
+    void set_flush_callback(std::function<void()> cb) { on_flush_ = std::move(cb); }
+
+    // 暂停或恢复读取, 暂停期间对端写满环后等待; 只能在 io 线程中调用
+    void pause();
+    void resume();
+
+    const std::string& name() const { return segment_->name(); }
+
+private:
+    using bell_socket = asio::local::datagram_protocol::socket;
+    using clock = std::chrono::steady_clock;
+
+    // 处理就绪的事件, spin 时长内没有新事件时登记睡眠
+    void poll();
+    // 投递一次 poll, 已经投递的尚未执行时什么也不做
+    void schedule_poll();
+    // 登记睡眠后复查, 仍没有事件时等待门铃
+    void sleep();
+    // 是否有需要处理的事件
+    bool ready() const;
+    // 读走所有数据并继续发送
+    void on_ready();
+    void drain();
+    void flush();
+    // 对端登记了睡眠时按门铃唤醒它
+    void ring_bell();
+
+    asio::io_context& ioc_;
+    std::unique_ptr<ShmSegment> segment_;
+    ShmOptions options_;
+    DataCallback on_data_;
+    std::function<void()> on_flush_;
+
+    ShmSegment::Ring& rx_;
+    ShmSegment::Ring& tx_;
+    char* rx_data_;
+    char* tx_data_;
+    uint64_t mask_;
+
+    ShmSegment::Doorbell& bell_;      // 本端的睡眠标记
+    ShmSegment::Doorbell& peer_bell_; // 对端的睡眠标记
+    bell_socket socket_;              // 本端的门铃, 也用于按对端的门铃
+    asio::local::datagram_protocol::endpoint peer_address_;
+    char bell_buf_[64];
+
+    std::unique_ptr<Buffer> recv_;
+    IOBuf pending_; // 环满时暂存的待发送数据
+    bool paused_ = false;
+    bool posted_ = false;  // 已投递 poll 尚未执行
+    bool waiting_ = false; // 门铃上有挂起的接收
+    clock::time_point idle_since_;
+};
+
+} // namespace net
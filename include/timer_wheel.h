@@ -0,0 +1,105 @@
+#pragma once
+
+#include "log.h"
+#include <boost/asio.hpp>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace net
+{
+
+namespace asio = boost::asio;
+
+// 定时器句柄, 0 表示无效
+using TimerId = uint64_t;
+
+// 挂在 io_context 上的分层时间轮, 每个 io 线程一个
+// 共 LEVELS 层, 每层 SLOTS 个槽, 第 n 层一个槽覆盖 SLOTS^n 个刻度; 定时器按到期刻度与当前刻度的距离放进对应层的槽中,
+// 低层转完一圈时把上一层当前槽中的定时器重新分配到下层. 定时器节点放在连续的数组中并复用, 槽内以下标串成双向链表,
+// 添加和取消都是 O(1), 不做堆分配 (回调本身除外).
+// 底层只有一个 steady_timer, 只在有定时器时按最近一个非空槽的刻度唤醒, 空闲的 io 线程不会被周期性唤醒.
+// 除 size() 外的接口都只能在 io 线程中调用
+class TimerWheel : public asio::execution_context::service
+{
+public:
+    using key_type = TimerWheel;
+    static asio::execution_context::id id;
+
+    using clock = std::chrono::steady_clock;
+
+    // 刻度, 到期时间按刻度向上取整
+    static constexpr std::chrono::milliseconds TICK{ 1 };
+    // 每层 64 个槽, 4 层覆盖 2^24 个刻度 (约 4.6 小时), 更远的定时器到达顶层后重新放置
+    static constexpr size_t SLOT_BITS = 6;
+    static constexpr size_t SLOTS = size_t(1) << SLOT_BITS;
+    static constexpr size_t LEVELS = 4;
+
+    explicit TimerWheel(asio::io_context& ioc);
+    ~TimerWheel() override;
+
+    // delay 之后回调, 返回可用于 cancel 的句柄
+    TimerId add(std::chrono::milliseconds delay, std::function<void()> cb);
+    // 在 when 时刻回调, when 已过时在下一个刻度回调
+    TimerId add_at(clock::time_point when, std::function<void()> cb);
+    // 取消尚未到期的定时器, 回调被释放且不会执行; 句柄已到期、已取消或为 0 时什么也不做
+    void cancel(TimerId timer);
+
+    // 尚未到期的定时器数
+    size_t size() const { return size_; }
+
+    // 执行到当前时间为止到期的定时器; 平时由底层的 steady_timer 触发, 不需要调用
+    void poll();
+    // 替换时间来源并以它的当前时刻作为起点, 只供测试以虚拟时间驱动时间轮 (配合 poll), 需在添加定时器之前调用
+    void set_time_source(std::function<clock::time_point()> now);
+
+private:
+    static constexpr uint32_t NIL = UINT32_MAX;
+    static constexpr uint64_t MASK = SLOTS - 1;
+
+    // 定时器节点, 通过下标串在槽的链表或空闲链表中
+    struct Node
+    {
+        uint64_t expire = 0;     // 到期刻度
+        uint32_t generation = 0; // 节点每次复用加一, 使旧句柄失效
+        uint32_t prev = NIL;
+        uint32_t next = NIL;
+        uint16_t slot = 0;       // 所在的槽, level * SLOTS + 下标
+        bool active = false;
+        std::function<void()> cb;
+    };
+
+    void shutdown() override;
+    clock::time_point now() const { return now_ ? now_() : clock::now(); }
+    uint64_t now_tick() const;
+    // 按到期刻度放进对应的层和槽
+    void place(uint32_t index);
+    void unlink(uint32_t index);
+    void release(uint32_t index);
+    // 把第 level 层的一个槽中的定时器重新放置到下层
+    void cascade(size_t level, size_t slot);
+    // 按流逝的时间逐个刻度推进, 执行到期的定时器
+    void advance();
+    // 最近一个需要处理的刻度: 第 0 层的到期刻度或上层的重新分配时刻
+    uint64_t next_tick() const;
+    void arm();
+
+    asio::io_context& ioc_;
+    asio::steady_timer timer_;
+    std::function<clock::time_point()> now_; // 为空时使用 clock::now
+    std::array<uint32_t, LEVELS * SLOTS> heads_;
+    std::vector<Node> nodes_;
+    uint32_t free_ = NIL;
+    clock::time_point start_;
+    uint64_t current_{ 0 }; // 已经处理完的刻度
+    size_t size_{ 0 };
+    uint64_t armed_tick_{ 0 }; // steady_timer 等待的刻度, 0 表示没有在等待
+    bool stopped_{ false };
+};
+
+// ioc 上的时间轮, 第一次使用时创建
+TimerWheel& timer_wheel(asio::io_context& ioc);
+
+} // namespace net
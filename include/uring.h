@@ -0,0 +1,199 @@
+#pragma once
+
+#include "log.h"
+#include <boost/asio.hpp>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#ifdef NET_HAS_IO_URING
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+
+namespace net
+{
+
+namespace asio = boost::asio;
+
+class Buffer;
+class IOBuf;
+
+// 套接字读写使用的内核接口
+enum class Transport
+{
+    EPOLL,    // asio 默认的 epoll reactor, 每次读写一次系统调用
+    IO_URING, // io_uring, 多发接收 + 批量提交, 需以 NET_HAS_IO_URING 编译
+};
+
+// io_uring 的配置
+struct UringOptions
+{
+    // 提交队列的长度
+    unsigned entries = 1024;
+    // 提供给内核的接收缓冲区个数 (必须是 2 的幂) 与每个缓冲区的大小
+    unsigned buffer_count = 1024;
+    unsigned buffer_size = 16 * 1024;
+};
+
+// 为 ioc 启用 io_uring 传输, 需在 ioc 运行之前调用
+// 之后在该 ioc 上启动的 Server/Session/Client 的套接字读写都改走 io_uring;
+// 未以 NET_HAS_IO_URING 编译或内核不支持时返回 false, 继续使用 epoll
+bool enable_io_uring(asio::io_context& ioc, const UringOptions& options = {});
+
+#ifdef NET_HAS_IO_URING
+
+// 一个在途的 io_uring 操作, 地址即 sqe 的 user_data
+// 多发操作在收到不带 IORING_CQE_F_MORE 的完成事件后才结束
+struct UringOp
+{
+    // 完成回调, 参数为 cqe 的 res 与 flags
+    std::function<void(int res, uint32_t flags)> complete;
+
+    // 以下由 UringContext 维护
+    std::shared_ptr<void> hold; // 操作结束前保持所有者存活
+    UringOp* prev = nullptr;
+    UringOp* next = nullptr;
+    bool active = false;
+};
+
+// 挂在 io_context 上的 io_uring 实例
+// 完成事件通过注册的 eventfd 唤醒 io_context, 在其线程中一次收割所有完成事件,
+// 收割期间产生的新请求攒到最后用一次 io_uring_enter 提交; 所有操作只能在该 io_context 的线程中发起.
+// 在完成回调中重新发起同一个操作时 hold 可以传空, 沿用本次操作的所有者
+class UringContext : public asio::execution_context::service
+{
+public:
+    using key_type = UringContext;
+    static asio::execution_context::id id;
+
+    UringContext(asio::execution_context& ctx, asio::io_context& ioc, const UringOptions& options);
+    // 供 asio::use_service 使用默认配置创建
+    explicit UringContext(asio::io_context& ioc) : UringContext(ioc, ioc, UringOptions{}) {}
+    ~UringContext() override;
+
+    // 在 fd 上发起多发接收, 数据放在内核从缓冲区环中挑选的缓冲区里
+    void recv_multishot(int fd, UringOp* op, std::shared_ptr<void> hold);
+    // 在 fd 上聚集发送 msg 描述的数据, msg 在完成前必须保持有效
+    void sendmsg(int fd, const msghdr* msg, UringOp* op, std::shared_ptr<void> hold);
+    // 在监听套接字上发起多发 accept
+    void accept_multishot(int fd, UringOp* op, std::shared_ptr<void> hold);
+    // 取消在途的操作, 操作随后以 -ECANCELED 结束
+    void cancel(UringOp* op);
+
+    // 完成事件中携带的接收缓冲区, 用完后必须调用 recycle 还给内核
+    const char* buffer(uint32_t flags) const;
+    void recycle(uint32_t flags);
+
+private:
+    void shutdown() override;
+
+    io_uring_sqe* get_sqe();
+    void start(io_uring_sqe* sqe, UringOp* op, std::shared_ptr<void> hold);
+    // 提交所有攒下的请求
+    void submit();
+    // 收割完成队列中的所有事件
+    void reap();
+    void wait_event();
+
+    asio::io_context& ioc_;
+    int ring_fd_{ -1 };
+    int event_fd_{ -1 };
+    asio::posix::stream_descriptor event_;
+    uint64_t event_count_{ 0 };
+
+    // 提交队列与完成队列的映射
+    void* sq_ptr_{ nullptr };
+    size_t sq_size_{ 0 };
+    void* cq_ptr_{ nullptr };
+    size_t cq_size_{ 0 };
+    io_uring_sqe* sqes_{ nullptr };
+    size_t sqes_size_{ 0 };
+    unsigned* sq_head_{ nullptr };
+    unsigned* sq_tail_{ nullptr };
+    unsigned sq_mask_{ 0 };
+    unsigned sq_entries_{ 0 };
+    unsigned sq_local_tail_{ 0 };
+    unsigned* cq_head_{ nullptr };
+    unsigned* cq_tail_{ nullptr };
+    unsigned cq_mask_{ 0 };
+    io_uring_cqe* cqes_{ nullptr };
+
+    // 提供给内核的接收缓冲区环
+    io_uring_buf_ring* buf_ring_{ nullptr };
+    size_t buf_ring_size_{ 0 };
+    char* buffers_{ nullptr };
+    unsigned buffer_count_{ 0 };
+    unsigned buffer_size_{ 0 };
+    uint16_t buf_tail_{ 0 };
+
+    // 在途操作的链表, 关闭时据此取消并释放所有者
+    UringOp* active_{ nullptr };
+    bool submit_posted_{ false };
+    bool reaping_{ false };
+};
+
+// ioc 上启用的 io_uring 实例, 未启用时返回空
+UringContext* uring_of(asio::io_context& ioc);
+
+// 基于 io_uring 的字节流, Session 和 Client 在 io_uring 模式下用它代替 asio 套接字读写
+// 由所有者持有, 所有者通过 hold 保证在途操作结束前自身和本对象都存活
+class UringStream
+{
+public:
+    // on_data: 新数据已追加到接收缓冲区; on_write: 一批数据全部发送完或失败 (err 非 0);
+    // on_eof: 读端结束 (对端关闭、出错或被 shutdown), 之后不再有 on_data
+    struct Callbacks
+    {
+        std::function<void()> on_data;
+        std::function<void(int err)> on_write;
+        std::function<void()> on_eof;
+    };
+
+    UringStream(UringContext& ctx, int fd, Buffer& recv, Callbacks callbacks);
+    ~UringStream();
+
+    UringStream(const UringStream&) = delete;
+    UringStream& operator=(const UringStream&) = delete;
+
+    // 开始接收, 只需调用一次
+    void start(std::shared_ptr<void> hold);
+    // 发送 data 中的全部数据, 上一批完成前不能再次调用; data 在完成前必须保持不变
+    void write(IOBuf& data, std::shared_ptr<void> hold);
+    // 关闭读写两端, 在途的接收随之结束; 可在任意线程调用
+    void shutdown();
+    // 暂停接收: 取消在途的多发接收, 之后不再有 on_data 直到 resume; resume 重新发起接收
+    void pause();
+    void resume(std::shared_ptr<void> hold);
+
+    int fd() const { return fd_; }
+
+private:
+    void on_recv(int res, uint32_t flags);
+    void on_send(int res);
+    void send_pending();
+
+    UringContext& ctx_;
+    int fd_;
+    Buffer& recv_;
+    Callbacks callbacks_;
+    UringOp recv_op_;
+    UringOp send_op_;
+
+    bool paused_{ false };
+    bool cancelling_{ false }; // pause 发出的取消尚未完成
+
+    IOBuf* writing_{ nullptr };
+    std::vector<iovec> iov_;
+    msghdr msg_{};
+};
+
+#else
+
+class UringContext;
+inline UringContext* uring_of(asio::io_context&) { return nullptr; }
+
+#endif // NET_HAS_IO_URING
+
+} // namespace net
@@ -0,0 +1,116 @@
+#include "../include/buffer_pool.h"
+#include <bit>
+#include <new>
+
+namespace net
+{
+
+BufferPool& BufferPool::instance()
+{
+    static BufferPool pool;
+    return pool;
+}
+
+// 进程退出时释放全局链表中的块, 各线程缓存此时都已归还
+BufferPool::~BufferPool()
+{
+    for (auto& list : free_lists_) {
+        for (char* block : list.blocks) {
+            ::operator delete(block);
+        }
+    }
+}
+
+BufferPool::ThreadCache::~ThreadCache()
+{
+    BufferPool& pool = instance();
+    for (size_t i = 0; i < CLASS_COUNT; ++i) {
+        if (blocks[i].empty()) {
+            continue;
+        }
+        FreeList& list = pool.free_lists_[i];
+        std::lock_guard<std::mutex> lock(list.mtx);
+        list.blocks.insert(list.blocks.end(), blocks[i].begin(), blocks[i].end());
+    }
+}
+
+BufferPool::ThreadCache& BufferPool::thread_cache()
+{
+    thread_local ThreadCache cache;
+    return cache;
+}
+
+size_t BufferPool::class_of(size_t size)
+{
+    if (size <= MIN_BLOCK_SIZE) {
+        return 0;
+    }
+    return std::bit_width(size - 1) - MIN_BLOCK_SHIFT;
+}
+
+bool BufferPool::retain(size_t size)
+{
+    size_t limit = max_retained();
+    size_t cur = retained_.load(std::memory_order_relaxed);
+    do {
+        if (cur + size > limit) {
+            return false;
+        }
+    } while (!retained_.compare_exchange_weak(cur, cur + size, std::memory_order_relaxed));
+    return true;
+}
+
+char* BufferPool::allocate(size_t& size)
+{
+    // 超过最大级别的块不入池
+    if (size > MAX_BLOCK_SIZE) {
+        return static_cast<char*>(::operator new(size));
+    }
+
+    size_t index = class_of(size);
+    size = MIN_BLOCK_SIZE << index;
+
+    auto& cached = thread_cache().blocks[index];
+    if (!cached.empty()) {
+        char* block = cached.back();
+        cached.pop_back();
+        retained_.fetch_sub(size, std::memory_order_relaxed);
+        return block;
+    }
+
+    FreeList& list = free_lists_[index];
+    {
+        std::lock_guard<std::mutex> lock(list.mtx);
+        if (!list.blocks.empty()) {
+            char* block = list.blocks.back();
+            list.blocks.pop_back();
+            retained_.fetch_sub(size, std::memory_order_relaxed);
+            return block;
+        }
+    }
+    return static_cast<char*>(::operator new(size));
+}
+
+void BufferPool::deallocate(char* block, size_t size)
+{
+    if (block == nullptr) {
+        return;
+    }
+    if (size > MAX_BLOCK_SIZE || !retain(size)) {
+        ::operator delete(block);
+        return;
+    }
+
+    size_t index = class_of(size);
+    auto& cached = thread_cache().blocks[index];
+    if (cached.size() < THREAD_CACHE_BLOCKS) {
+        cached.push_back(block);
+        return;
+    }
+
+    FreeList& list = free_lists_[index];
+    std::lock_guard<std::mutex> lock(list.mtx);
+    list.blocks.push_back(block);
+}
+
+} // namespace net
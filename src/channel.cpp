@@ -0,0 +1,318 @@
+#include "../include/channel.h"
+
+namespace net
+{
+
+namespace
+{
+    thread_local Deadline t_deadline = Deadline::max();
+}
+
+Deadline current_deadline()
+{
+    return t_deadline;
+}
+
+DeadlineScope::DeadlineScope(Deadline deadline) :
+    saved_(t_deadline)
+{
+    t_deadline = deadline;
+}
+
+DeadlineScope::~DeadlineScope()
+{
+    t_deadline = saved_;
+}
+
+Channel::Channel(asio::io_context& ioc, const std::string& host, const std::string& port) :
+    ioc_(ioc),
+    host_(host),
+    port_(port)
+{
+}
+
+void Channel::start()
+{
+    // 连接只弱引用信道, 避免循环引用
+    std::weak_ptr<Channel> weak = shared_from_this();
+    client_ = std::make_shared<Client>(ioc_, host_, port_,
+        [weak](Buffer& recv) {
+            if (auto self = weak.lock()) {
+                self->on_message(recv);
+            }
+        });
+    client_->set_close_callback([weak]() {
+        if (auto self = weak.lock()) {
+            self->on_close();
+        }
+    });
+    if (shm_options_ && (is_unix_endpoint(host_) || is_local_host(host_))) {
+        start_shm();
+    }
+    client_->start();
+
+    if (heartbeat_.interval.count() > 0) {
+        asio::post(ioc_, [weak]() {
+            if (auto self = weak.lock()) {
+                self->last_recv_ = std::chrono::steady_clock::now();
+                self->heartbeat();
+            }
+        });
+    }
+}
+
+// 有数据往来时不发送心跳, 连接空闲超过 interval 后才探测一次;
+// 心跳帧是控制帧, 不进入服务端的处理器
+void Channel::heartbeat()
+{
+    if (closed()) {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (!ping_pending_ && now - last_recv_ >= heartbeat_.interval) {
+        ping_pending_ = true;
+        std::weak_ptr<Channel> weak = shared_from_this();
+        send_request(ProtocolType::PROTOBUF, PING_METHOD, "", FLAG_CONTROL,
+            [weak](RpcStatus status, const FrameView&) {
+                auto self = weak.lock();
+                if (!self) {
+                    return;
+                }
+                self->ping_pending_ = false;
+                if (status == RpcStatus::TIMEOUT) {
+                    WAR("Heartbeat to {}:{} timed out, close channel", self->host_, self->port_);
+                    self->close();
+                }
+            }, Deadline(now + heartbeat_.timeout));
+    }
+
+    std::weak_ptr<Channel> weak = shared_from_this();
+    timer_wheel(ioc_).add(heartbeat_.interval, [weak]() {
+        if (auto self = weak.lock()) {
+            self->heartbeat();
+        }
+    });
+}
+
+// 握手请求和普通请求一样进入在途表, 连接建立前就已排在发送队列的最前面
+void Channel::start_shm()
+{
+    std::string name = client_->create_shm(*shm_options_);
+    if (name.empty()) {
+        return;
+    }
+    std::weak_ptr<Client> weak = client_;
+    send_request(ProtocolType::PROTOBUF, SHM_ATTACH_METHOD, name, FLAG_CONTROL,
+        [weak](RpcStatus status, const FrameView&) {
+            if (auto client = weak.lock()) {
+                client->use_shm(status == RpcStatus::OK);
+            }
+        }, Deadline::max());
+}
+
+void Channel::close()
+{
+    if (client_) {
+        client_->close();
+    }
+}
+
+uint64_t Channel::async_call(ProtocolType type, const std::string& method, const std::string& body,
+                             ResponseCallback cb, Deadline deadline)
+{
+    return send_request(type, method, body, 0, std::move(cb), std::min(deadline, current_deadline()));
+}
+
+uint64_t Channel::send_request(ProtocolType type, const std::string& method, const std::string& body,
+                               uint8_t flags, ResponseCallback cb, Deadline deadline)
+{
+    uint64_t id = next_id_.fetch_add(1, std::memory_order_relaxed);
+
+    // 剩余时间按毫秒向上取整, 已经到期的请求不再发送
+    uint32_t timeout_ms = 0;
+    if (deadline != Deadline::max()) {
+        auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - Deadline::clock::now()).count();
+        if (remaining <= 0) {
+            asio::post(ioc_, [cb = std::move(cb)]() {
+                cb(RpcStatus::TIMEOUT, FrameView{});
+            });
+            return id;
+        }
+        timeout_ms = static_cast<uint32_t>(std::min<int64_t>(remaining, UINT32_MAX));
+    }
+
+    PendingCall call{ std::move(cb) };
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (!closed_.load(std::memory_order_relaxed)) {
+            pending_.emplace(id, std::move(call));
+            call.cb = nullptr;
+        }
+    }
+
+    // 连接已经断开, 直接在 io 线程中以失败结束
+    if (call.cb) {
+        asio::post(ioc_, [call = std::move(call)]() {
+            call.cb(RpcStatus::CONNECTION_CLOSED, FrameView{});
+        });
+        return id;
+    }
+
+    // 时间轮只在 io 线程中访问, 其他线程发起的请求稍后再挂定时器
+    if (deadline != Deadline::max()) {
+        std::weak_ptr<Channel> weak = shared_from_this();
+        asio::dispatch(ioc_, [weak, id, deadline]() {
+            if (auto self = weak.lock()) {
+                self->arm_deadline(id, deadline);
+            }
+        });
+    }
+
+    ProtocolTools::LVProtocol protocol(type, body);
+    protocol.method = method;
+    protocol.flags = flags;
+    protocol.request_id = id;
+    protocol.timeout_ms = timeout_ms;
+    client_->send(protocol.to_string());
+    return id;
+}
+
+void Channel::arm_deadline(uint64_t id, Deadline deadline)
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = pending_.find(id);
+    if (it == pending_.end()) {
+        return;
+    }
+    std::weak_ptr<Channel> weak = shared_from_this();
+    it->second.timer = timer_wheel(ioc_).add_at(deadline, [weak, id]() {
+        if (auto self = weak.lock()) {
+            self->on_timeout(id);
+        }
+    });
+}
+
+bool Channel::cancel(uint64_t id)
+{
+    PendingCall call;
+    if (!take_pending(id, call)) {
+        return false;
+    }
+    if (call.timer) {
+        std::shared_ptr<Channel> self = shared_from_this();
+        asio::dispatch(ioc_, [self, timer = call.timer]() {
+            timer_wheel(self->ioc_).cancel(timer);
+        });
+    }
+    return true;
+}
+
+bool Channel::closed()
+{
+    return closed_.load(std::memory_order_acquire);
+}
+
+size_t Channel::pending_size()
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    return pending_.size();
+}
+
+bool Channel::take_pending(uint64_t id, PendingCall& call)
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = pending_.find(id);
+    if (it == pending_.end()) {
+        return false;
+    }
+    call = std::move(it->second);
+    pending_.erase(it);
+    return true;
+}
+
+// 将帧头中的状态码转换为调用结果
+static RpcStatus to_rpc_status(StatusCode code)
+{
+    switch (code) {
+        case StatusCode::OK: return RpcStatus::OK;
+        case StatusCode::NO_HANDLER: return RpcStatus::NO_HANDLER;
+        case StatusCode::OVERLOADED: return RpcStatus::OVERLOADED;
+        default: return RpcStatus::HANDLER_ERROR;
+    }
+}
+
+void Channel::on_message(Buffer& recv)
+{
+    last_recv_ = std::chrono::steady_clock::now();
+    FrameDecoder decoder(recv.read_data(), recv.readable_size());
+    FrameView frame;
+    ParseResult res;
+    while ((res = decoder.next(frame)) == ParseResult::OK) {
+        frame.block = recv.block();
+        PendingCall call;
+        if (!take_pending(frame.request_id, call)) {
+            // 被取消的请求的响应也会走到这里
+            DBG("Drop response with unknown request id: {}", frame.request_id);
+            continue;
+        }
+
+        timer_wheel(ioc_).cancel(call.timer);
+        try {
+            call.cb(to_rpc_status(frame.status), frame);
+        } catch (const std::exception& e) {
+            ERR("Response callback error: {}", e.what());
+        }
+    }
+
+    if (res == ParseResult::INVALID) {
+        ERR("Invalid response frame, close channel to {}:{}", host_, port_);
+        recv.clear();
+        close();
+        return;
+    }
+    recv.advance_read(decoder.consumed());
+}
+
+void Channel::on_timeout(uint64_t id)
+{
+    PendingCall call;
+    if (!take_pending(id, call)) {
+        return; // 响应已经先到达
+    }
+
+    WAR("Request {} to {}:{} timed out", id, host_, port_);
+    try {
+        call.cb(RpcStatus::TIMEOUT, FrameView{});
+    } catch (const std::exception& e) {
+        ERR("Response callback error: {}", e.what());
+    }
+}
+
+// 连接断开, 所有在途请求以失败结束
+void Channel::on_close()
+{
+    std::unordered_map<uint64_t, PendingCall> pending;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        closed_.store(true, std::memory_order_release);
+        pending.swap(pending_);
+    }
+
+    for (auto& [id, call] : pending) {
+        timer_wheel(ioc_).cancel(call.timer);
+        try {
+            call.cb(RpcStatus::CONNECTION_CLOSED, FrameView{});
+        } catch (const std::exception& e) {
+            ERR("Response callback error: {}", e.what());
+        }
+    }
+
+    if (close_cb_) {
+        auto cb = std::move(close_cb_);
+        close_cb_ = nullptr;
+        cb();
+    }
+}
+
+} // namespace net
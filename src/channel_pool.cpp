@@ -0,0 +1,666 @@
+#include "../include/channel_pool.h"
+#include <random>
+
+namespace net
+{
+
+ChannelPool::ChannelPool(size_t io_threads)
+{
+    if (io_threads == 0) {
+        io_threads = 1;
+    }
+    for (size_t i = 0; i < io_threads; ++i) {
+        auto worker = std::make_unique<IoWorker>();
+        worker->work.emplace(worker->ioc);
+        IoWorker* raw = worker.get();
+        worker->thread = std::thread([raw]() { raw->ioc.run(); });
+        workers_.push_back(std::move(worker));
+    }
+}
+
+ChannelPool::~ChannelPool()
+{
+    stop();
+}
+
+void ChannelPool::add_node(const std::string& service, const std::string& endpoint)
+{
+    if (select_endpoint(endpoint).empty()) {
+        ERR("Invalid endpoint {} of service {}", endpoint, service);
+        return;
+    }
+
+    auto node = std::make_shared<Node>();
+    node->service = service;
+    node->endpoint = endpoint;
+    node->breaker = std::make_shared<CircuitBreaker>(breaker_options_, service + " node " + endpoint);
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (stopped_) {
+            return;
+        }
+        // 保活续约时同一节点会重复上线
+        auto& nodes = services_[service];
+        for (auto& n : nodes) {
+            if (n->endpoint == endpoint) {
+                return;
+            }
+        }
+        node->ioc = &workers_[next_worker_++ % workers_.size()]->ioc;
+        nodes.push_back(node);
+        publish();
+    }
+
+    INF("Service {} node {} online", service, endpoint);
+    connect(node);
+}
+
+void ChannelPool::remove_node(const std::string& service, const std::string& endpoint)
+{
+    NodePtr node;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        auto it = services_.find(service);
+        if (it == services_.end()) {
+            return;
+        }
+        auto& nodes = it->second;
+        for (auto n = nodes.begin(); n != nodes.end(); ++n) {
+            if ((*n)->endpoint == endpoint) {
+                node = *n;
+                nodes.erase(n);
+                break;
+            }
+        }
+        if (!node) {
+            return;
+        }
+        node->removed = true;
+        if (nodes.empty()) {
+            services_.erase(it);
+        }
+        publish();
+    }
+
+    INF("Service {} node {} offline", service, endpoint);
+    // 连接只在自己的 io 线程中关闭
+    asio::post(*node->ioc, [this, node]() {
+        timer_wheel(*node->ioc).cancel(node->reconnect_timer);
+        std::shared_ptr<Channel> channel;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            channel = node->channel;
+        }
+        if (channel) {
+            channel->close();
+        }
+    });
+}
+
+std::shared_ptr<Channel> ChannelPool::get(const std::string& service)
+{
+    return pick(service, std::string(), false).channel;
+}
+
+ChannelPool::Target ChannelPool::pick(const std::string& service, const std::string& avoid, bool probe)
+{
+    std::shared_ptr<const Snapshot> holder;
+    const Routes& routes = snapshot(holder).routes;
+    auto it = routes.find(service);
+    if (it == routes.end() || it->second.empty()) {
+        return Target();
+    }
+    const std::vector<Route>& nodes = it->second;
+    size_t n = nodes.size();
+
+    // 已连接且不是 avoid 的节点才是候选
+    auto candidate = [&avoid](const Route& route) {
+        Target target{ route.node, route.channel };
+        if (!target.channel || target.channel->closed() || (!avoid.empty() && route.node->endpoint == avoid)) {
+            target.channel = nullptr;
+        }
+        return target;
+    };
+    // 熔断器放行时选中; 半开的节点只在 probe 时作为探测放行
+    auto take = [probe](Target& target) {
+        if (!target.channel) {
+            return false;
+        }
+        if (!probe) {
+            return target.node->breaker->state() == BreakerState::CLOSED;
+        }
+        if (!target.node->breaker->allow(target.probe)) {
+            return false;
+        }
+        target.node->load.start();
+        return true;
+    };
+
+    thread_local std::minstd_rand rng{ std::random_device{}() };
+    size_t first = rng() % n;
+    if (n >= 2) {
+        // 随机取两个不同的节点, 优先得分较低的; 没有延迟样本的节点借用另一个的延迟, 只比较在途请求数
+        size_t second = rng() % (n - 1);
+        second += second >= first;
+        Target a = candidate(nodes[first]);
+        Target b = candidate(nodes[second]);
+        if (a.channel && b.channel) {
+            double la = a.node->load.latency(), lb = b.node->load.latency();
+            if (b.node->load.score(la) < a.node->load.score(lb)) {
+                std::swap(a, b);
+            }
+        }
+        if (take(a)) {
+            return a;
+        }
+        if (take(b)) {
+            return b;
+        }
+    }
+
+    // 两个候选都不可用时从随机位置依次检查其余节点, avoid 只在没有其他可用节点时才选
+    const Route* fallback = nullptr;
+    for (size_t i = 0; i < n; ++i) {
+        const Route& route = nodes[(first + i) % n];
+        if (!avoid.empty() && route.node->endpoint == avoid) {
+            fallback = &route;
+            continue;
+        }
+        Target target = candidate(route);
+        if (take(target)) {
+            return target;
+        }
+    }
+    if (fallback) {
+        Target target{ fallback->node, fallback->channel };
+        if (target.channel && !target.channel->closed() && take(target)) {
+            return target;
+        }
+    }
+    return Target();
+}
+
+void ChannelPool::report(const Target& target, RpcStatus status, std::chrono::microseconds latency)
+{
+    target.node->breaker->record(status, latency, target.probe);
+    target.node->load.finish(status, latency);
+}
+
+void ChannelPool::release(const Target& target)
+{
+    target.node->breaker->release(target.probe);
+    target.node->load.cancel();
+}
+
+asio::awaitable<bool> ChannelPool::sleep_for(asio::io_context* fallback, std::chrono::milliseconds delay)
+{
+    asio::io_context* ioc = fallback ? fallback : &workers_.front()->ioc;
+    auto ex = co_await asio::this_coro::executor;
+    if (auto* io = ex.target<asio::io_context::executor_type>()) {
+        ioc = &io->context();
+    }
+
+    auto wait = std::make_shared<Backoff>();
+    wait->ioc = ioc;
+    auto initiation = [this, wait, delay](auto handler) {
+        auto shared = std::make_shared<decltype(handler)>(std::move(handler));
+        wait->resume = [shared](bool slept) {
+            auto ex = asio::get_associated_executor(*shared);
+            asio::post(ex, [shared, slept]() { (*shared)(slept); });
+        };
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            if (!stopped_) {
+                backoffs_.insert(wait);
+            }
+        }
+        if (stopped()) {
+            finish_backoff(wait, false);
+            return;
+        }
+        // 时间轮只在 io 线程中访问
+        asio::dispatch(*wait->ioc, [this, wait, delay]() {
+            if (wait->finished.load()) {
+                return;
+            }
+            wait->timer = timer_wheel(*wait->ioc).add(delay, [this, wait]() { finish_backoff(wait, true); });
+        });
+    };
+    bool slept = co_await asio::async_initiate<decltype(asio::use_awaitable), void(bool)>(std::move(initiation),
+                                                                                          asio::use_awaitable);
+    co_return slept && !stopped();
+}
+
+void ChannelPool::finish_backoff(const std::shared_ptr<Backoff>& wait, bool slept)
+{
+    if (wait->finished.exchange(true)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        backoffs_.erase(wait);
+    }
+    wait->resume(slept);
+}
+
+bool ChannelPool::stopped()
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    return stopped_;
+}
+
+void ChannelPool::publish()
+{
+    auto snapshot = std::make_shared<Snapshot>();
+    for (auto& [service, nodes] : services_) {
+        auto& routes = snapshot->routes[service];
+        routes.reserve(nodes.size());
+        for (auto& node : nodes) {
+            routes.push_back(Route{ node, node->channel });
+        }
+    }
+    snapshot->policies = policies_;
+    snapshot_ = std::move(snapshot);
+    version_.fetch_add(1, std::memory_order_release);
+}
+
+const ChannelPool::Snapshot& ChannelPool::snapshot(std::shared_ptr<const Snapshot>& holder)
+{
+    static std::atomic<uint64_t> next_thread{ 0 };
+    thread_local const uint64_t thread = ++next_thread;
+
+    uint64_t version = version_.load(std::memory_order_acquire);
+    // 从按线程编号散列的位置开始找本线程的槽, 没有时占用一个空闲的
+    size_t start = thread % SNAPSHOT_SLOTS;
+    for (size_t i = 0; i < SNAPSHOT_SLOTS; ++i) {
+        SnapshotSlot& slot = slots_[(start + i) % SNAPSHOT_SLOTS];
+        uint64_t owner = slot.owner.load(std::memory_order_relaxed);
+        if (owner != thread &&
+            (owner != 0 || !slot.owner.compare_exchange_strong(owner, thread, std::memory_order_relaxed))) {
+            continue;
+        }
+        if (slot.version != version) {
+            std::lock_guard<std::mutex> lock(mtx_);
+            slot.snapshot = snapshot_;
+            slot.version = version_.load(std::memory_order_relaxed);
+        }
+        return *slot.snapshot;
+    }
+
+    std::lock_guard<std::mutex> lock(mtx_);
+    holder = snapshot_;
+    return *holder;
+}
+
+std::shared_ptr<Channel> ChannelPool::get(const std::string& service, const std::string& endpoint)
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = services_.find(service);
+    if (it == services_.end()) {
+        return nullptr;
+    }
+    for (auto& node : it->second) {
+        if (node->endpoint == endpoint) {
+            return node->channel;
+        }
+    }
+    return nullptr;
+}
+
+std::vector<std::string> ChannelPool::endpoints(const std::string& service)
+{
+    std::vector<std::string> result;
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = services_.find(service);
+    if (it != services_.end()) {
+        for (auto& node : it->second) {
+            result.push_back(node->endpoint);
+        }
+    }
+    return result;
+}
+
+std::vector<ChannelPool::EndpointStats> ChannelPool::endpoint_stats(const std::string& service)
+{
+    std::vector<EndpointStats> result;
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = services_.find(service);
+    if (it == services_.end()) {
+        return result;
+    }
+    for (auto& node : it->second) {
+        EndpointStats stats;
+        auto channel = node->channel;
+        stats.endpoint = node->endpoint;
+        stats.connected = channel && !channel->closed();
+        stats.breaker = node->breaker->state();
+        stats.opened = node->breaker->opened();
+        stats.half_opened = node->breaker->half_opened();
+        stats.closed = node->breaker->closed();
+        stats.inflight = node->load.inflight.load(std::memory_order_relaxed);
+        stats.latency_us = node->load.latency();
+        result.push_back(std::move(stats));
+    }
+    return result;
+}
+
+template <typename Update>
+void ChannelPool::update_policy(const std::string& service, Update&& update)
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto& current = policies_[service];
+    auto policy = current ? std::make_shared<ServicePolicy>(*current) : std::make_shared<ServicePolicy>();
+    if (!policy->budget) {
+        policy->budget = std::make_shared<RetryBudget>();
+    }
+    update(*policy);
+    current = std::move(policy);
+    publish();
+}
+
+void ChannelPool::set_retry_policy(const std::string& service, const std::string& method,
+                                   const RetryPolicy& policy)
+{
+    auto retry = std::make_shared<const RetryPolicy>(policy);
+    update_policy(service, [&](ServicePolicy& p) { p.retries[method] = std::move(retry); });
+}
+
+void ChannelPool::set_retry_budget(const std::string& service, double ratio, double max_tokens)
+{
+    auto budget = std::make_shared<RetryBudget>(ratio, max_tokens);
+    update_policy(service, [&](ServicePolicy& p) { p.budget = std::move(budget); });
+}
+
+std::shared_ptr<RetryBudget> ChannelPool::retry_budget(const std::string& service)
+{
+    return method_policy(service, std::string()).budget;
+}
+
+void ChannelPool::set_hedge_policy(const std::string& service, const std::string& method,
+                                   const HedgePolicy& policy)
+{
+    auto hedge = std::make_shared<HedgeState>(policy);
+    update_policy(service, [&](ServicePolicy& p) { p.hedges[method] = std::move(hedge); });
+}
+
+std::shared_ptr<HedgeState> ChannelPool::hedge_state(const std::string& service, const std::string& method)
+{
+    return method_policy(service, method).hedge;
+}
+
+ChannelPool::MethodPolicy ChannelPool::method_policy(const std::string& service, const std::string& method)
+{
+    static const auto no_retry = std::make_shared<const RetryPolicy>();
+
+    std::shared_ptr<const Snapshot> holder;
+    const Policies* policies = &snapshot(holder).policies;
+    auto it = policies->find(service);
+    if (it == policies->end()) {
+        // 只在服务第一次被调用时发生
+        update_policy(service, [](ServicePolicy&) {});
+        policies = &snapshot(holder).policies;
+        it = policies->find(service);
+    }
+    const ServicePolicy& service_policy = *it->second;
+
+    MethodPolicy result;
+    result.budget = service_policy.budget;
+    auto retry = service_policy.retries.find(method);
+    if (retry == service_policy.retries.end()) {
+        retry = service_policy.retries.find(std::string());
+    }
+    result.retry = retry == service_policy.retries.end() ? no_retry : retry->second;
+    auto hedge = service_policy.hedges.find(method);
+    if (hedge != service_policy.hedges.end()) {
+        result.hedge = hedge->second;
+    }
+    return result;
+}
+
+// 一次对冲调用的共享状态, 两个请求的回调可能在不同的 io 线程中执行
+// 下标 0 是首个请求, 1 是备份请求
+struct ChannelPool::HedgedCall : std::enable_shared_from_this<HedgedCall>
+{
+    ChannelPool* pool = nullptr;
+    std::shared_ptr<HedgeState> hedge;
+    ResponseCallback done;
+    asio::io_context* ioc = nullptr; // 首个请求所在的 io_context, 对冲定时器挂在它的时间轮上
+    TimerId timer = 0;               // 只在 ioc 线程中访问
+
+    std::mutex mtx;
+    bool finished = false;
+    Target targets[2];
+    uint64_t ids[2] = { 0, 0 };
+    bool active[2] = { false, false };
+    std::chrono::steady_clock::time_point sent[2];
+
+    // 请求 index 返回, 在该请求所在的 io 线程中执行
+    void on_reply(int index, RpcStatus status, const FrameView& frame);
+};
+
+void ChannelPool::HedgedCall::on_reply(int index, RpcStatus status, const FrameView& frame)
+{
+    auto now = std::chrono::steady_clock::now();
+    auto latency = std::chrono::duration_cast<std::chrono::microseconds>(now - sent[index]);
+    pool->report(targets[index], status, latency);
+
+    int other = 1 - index;
+    Target loser;
+    uint64_t loser_id = 0;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (finished) {
+            return;
+        }
+        active[index] = false;
+        // 另一个请求仍在途时失败的一方不结束调用
+        if (status != RpcStatus::OK && active[other]) {
+            return;
+        }
+        finished = true;
+        if (active[other]) {
+            loser = targets[other];
+            loser_id = ids[other];
+        }
+    }
+
+    // 备份请求的 id 可能还没记下, 此时由发起方在记下 id 后取消
+    if (loser.channel && loser_id && loser.channel->cancel(loser_id)) {
+        pool->release(loser);
+    }
+    asio::dispatch(*ioc, [self = shared_from_this()]() {
+        timer_wheel(*self->ioc).cancel(self->timer);
+        self->timer = 0;
+    });
+
+    // 分位数取调用方实际等待的时间, 从首个请求发出算起; 只记一次, 备份请求自己的往返时间会使对冲越来越早.
+    // 超时同样记入, 慢的节点不能因为没有成功而被忽略; 快速失败的调用不应使延迟显得更短
+    if (status == RpcStatus::OK || status == RpcStatus::TIMEOUT) {
+        hedge->latency.record(std::chrono::duration_cast<std::chrono::microseconds>(now - sent[0]));
+    }
+    if (status == RpcStatus::OK && index == 1) {
+        hedge->backup_won.fetch_add(1, std::memory_order_relaxed);
+    }
+    done(status, frame);
+}
+
+void ChannelPool::hedged_call(const std::string& service, Target target, ProtocolType type,
+                              const std::string& method, std::shared_ptr<const std::string> body, Deadline deadline,
+                              std::shared_ptr<HedgeState> hedge, ResponseCallback done)
+{
+    auto call = std::make_shared<HedgedCall>();
+    call->pool = this;
+    call->hedge = hedge;
+    call->done = std::move(done);
+    call->ioc = &target.channel->get_io_context();
+    call->targets[0] = target;
+    call->active[0] = true;
+    call->sent[0] = std::chrono::steady_clock::now();
+
+    std::string endpoint = target.node->endpoint;
+    uint64_t id = target.channel->async_call(type, method, *body,
+        [call](RpcStatus status, const FrameView& frame) { call->on_reply(0, status, frame); }, deadline);
+    {
+        std::lock_guard<std::mutex> lock(call->mtx);
+        call->ids[0] = id;
+    }
+
+    // 延迟样本不足或等不到对冲时刻就已超时的调用不对冲
+    auto delay = hedge->delay();
+    Deadline hedge_at = call->sent[0] + delay;
+    if (delay.count() == 0 || hedge_at >= deadline) {
+        return;
+    }
+
+    auto send_backup = [this, call, service, endpoint, type, method, body, deadline]() {
+        {
+            std::lock_guard<std::mutex> lock(call->mtx);
+            if (call->finished) {
+                return;
+            }
+        }
+        if (!call->hedge->limiter.try_acquire()) {
+            return;
+        }
+        Target backup = pick(service, endpoint, true);
+        if (!backup.channel) {
+            return;
+        }
+        // 没有其他可用节点, 选中的仍是首个请求的节点
+        if (backup.node->endpoint == endpoint) {
+            release(backup);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(call->mtx);
+            if (call->finished) {
+                release(backup);
+                return;
+            }
+            call->targets[1] = backup;
+            call->active[1] = true;
+            call->sent[1] = std::chrono::steady_clock::now();
+        }
+
+        call->hedge->hedged.fetch_add(1, std::memory_order_relaxed);
+        uint64_t id = backup.channel->async_call(type, method, *body,
+            [call](RpcStatus status, const FrameView& frame) { call->on_reply(1, status, frame); }, deadline);
+        bool cancel;
+        {
+            std::lock_guard<std::mutex> lock(call->mtx);
+            call->ids[1] = id;
+            cancel = call->finished && call->active[1];
+        }
+        if (cancel && backup.channel->cancel(id)) {
+            release(backup);
+        }
+    };
+
+    // 时间轮只在 io 线程中访问
+    asio::dispatch(*call->ioc, [call, hedge_at, send_backup = std::move(send_backup)]() mutable {
+        {
+            std::lock_guard<std::mutex> lock(call->mtx);
+            if (call->finished) {
+                return;
+            }
+        }
+        call->timer = timer_wheel(*call->ioc).add_at(hedge_at, [call, send_backup = std::move(send_backup)]() {
+            call->timer = 0;
+            send_backup();
+        });
+    });
+}
+
+void ChannelPool::stop()
+{
+    Services services;
+    std::unordered_set<std::shared_ptr<Backoff>> backoffs;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (stopped_) {
+            return;
+        }
+        stopped_ = true;
+        services.swap(services_);
+        backoffs.swap(backoffs_);
+        publish();
+    }
+
+    // 在 io 线程退出之前结束所有退避中的重试, 协程以 NO_ENDPOINT 返回
+    for (auto& wait : backoffs) {
+        asio::post(*wait->ioc, [wait]() { timer_wheel(*wait->ioc).cancel(wait->timer); });
+        finish_backoff(wait, false);
+    }
+
+    for (auto& [name, nodes] : services) {
+        for (auto& node : nodes) {
+            asio::post(*node->ioc, [node, channel = node->channel]() {
+                timer_wheel(*node->ioc).cancel(node->reconnect_timer);
+                if (channel) {
+                    channel->close();
+                }
+            });
+        }
+    }
+
+    // 关闭连接的回调执行完后 io 线程自然退出
+    for (auto& worker : workers_) {
+        worker->work.reset();
+    }
+    for (auto& worker : workers_) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+void ChannelPool::connect(const NodePtr& node)
+{
+    // 每次连接时重新选择地址, 同主机的节点优先走 Unix 域套接字
+    std::string host, port;
+    split_endpoint(select_endpoint(node->endpoint), host, port);
+    auto channel = std::make_shared<Channel>(*node->ioc, host, port);
+    if (shm_options_) {
+        channel->enable_shm(*shm_options_);
+    }
+    channel->set_heartbeat(heartbeat_);
+
+    // 回调只弱引用节点, 节点下线后不再重连
+    std::weak_ptr<Node> weak = node;
+    channel->set_close_callback([this, weak]() {
+        if (auto node = weak.lock()) {
+            on_channel_close(node);
+        }
+    });
+
+    // 在锁内启动, 保证下线时关闭的一定是已经启动的连接
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (stopped_ || node->removed) {
+        return;
+    }
+    node->channel = channel;
+    publish();
+    channel->start();
+}
+
+void ChannelPool::on_channel_close(const NodePtr& node)
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (stopped_ || node->removed) {
+            return;
+        }
+    }
+
+    WAR("Channel to {} of service {} closed, reconnect in {}ms",
+        node->endpoint, node->service, RECONNECT_INTERVAL.count());
+    std::weak_ptr<Node> weak = node;
+    node->reconnect_timer = timer_wheel(*node->ioc).add(RECONNECT_INTERVAL, [this, weak]() {
+        if (auto node = weak.lock()) {
+            node->reconnect_timer = 0;
+            connect(node);
+        }
+    });
+}
+
+} // namespace net
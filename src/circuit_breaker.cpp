@@ -0,0 +1,172 @@
+#include "../include/circuit_breaker.h"
+#include <algorithm>
+
+namespace net
+{
+
+const char* to_string(BreakerState state)
+{
+    switch (state) {
+        case BreakerState::CLOSED: return "closed";
+        case BreakerState::OPEN: return "open";
+        case BreakerState::HALF_OPEN: return "half-open";
+    }
+    return "unknown";
+}
+
+CircuitBreaker::CircuitBreaker(const BreakerOptions& options, std::string name) :
+    options_(options),
+    bucket_length_(std::max<clock::duration>(options.window / std::max<size_t>(options.buckets, 1),
+                                             clock::duration(1))),
+    name_(std::move(name)),
+    window_(std::max<size_t>(options.buckets, 1))
+{
+}
+
+namespace
+{
+    uint64_t round_of(uint64_t probes) { return probes >> 32; }
+    uint32_t count_of(uint64_t probes) { return static_cast<uint32_t>(probes); }
+}
+
+bool CircuitBreaker::allow(uint64_t& probe)
+{
+    probe = 0;
+    if (!options_.enabled) {
+        return true;
+    }
+    BreakerState state = state_.load(std::memory_order_acquire);
+    if (state == BreakerState::CLOSED) {
+        return true;
+    }
+    if (state == BreakerState::OPEN) {
+        if (clock::now().time_since_epoch().count() < open_until_.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(mtx_);
+        // 加锁前可能已被其他线程转入半开, 或者又重新熔断
+        if (state_.load(std::memory_order_relaxed) == BreakerState::OPEN &&
+            clock::now().time_since_epoch().count() >= open_until_.load(std::memory_order_relaxed)) {
+            transition(BreakerState::HALF_OPEN);
+        }
+        state = state_.load(std::memory_order_relaxed);
+        if (state != BreakerState::HALF_OPEN) {
+            return state == BreakerState::CLOSED;
+        }
+    }
+
+    // 半开: 名额用完后拒绝, 直到探测结果使熔断器恢复或重新熔断; 重新熔断时名额被占满, CAS 不会成功
+    uint64_t probes = probes_.load(std::memory_order_acquire);
+    do {
+        if (count_of(probes) >= options_.probes) {
+            return false;
+        }
+    } while (!probes_.compare_exchange_weak(probes, probes + 1, std::memory_order_acq_rel));
+    probe = round_of(probes);
+    return true;
+}
+
+void CircuitBreaker::record(RpcStatus status, std::chrono::microseconds latency, uint64_t probe)
+{
+    if (!options_.enabled) {
+        return;
+    }
+    bool failure = status == RpcStatus::CONNECTION_CLOSED || status == RpcStatus::TIMEOUT ||
+                   status == RpcStatus::OVERLOADED ||
+                   (options_.slow_call.count() > 0 && latency > options_.slow_call);
+
+    std::lock_guard<std::mutex> lock(mtx_);
+    BreakerState state = state_.load(std::memory_order_relaxed);
+    if (probe != 0) {
+        // 之前某一轮半开放行的探测请求不影响当前状态
+        if (state != BreakerState::HALF_OPEN || probe != round_of(probes_.load(std::memory_order_relaxed))) {
+            return;
+        }
+        if (failure) {
+            transition(BreakerState::OPEN);
+        } else if (++probe_successes_ >= options_.probes) {
+            transition(BreakerState::CLOSED);
+        }
+        return;
+    }
+    // 熔断之前放行的请求
+    if (state != BreakerState::CLOSED) {
+        return;
+    }
+
+    int64_t now = epoch(clock::now());
+    Bucket& bucket = window_[static_cast<size_t>(now) % window_.size()];
+    if (bucket.epoch != now) {
+        bucket = Bucket{ now, 0, 0 };
+    }
+    ++bucket.total;
+    bucket.failures += failure;
+    if (!failure) {
+        return;
+    }
+
+    uint64_t total = 0, failures = 0;
+    int64_t oldest = now - static_cast<int64_t>(window_.size());
+    for (const Bucket& b : window_) {
+        if (b.epoch > oldest) {
+            total += b.total;
+            failures += b.failures;
+        }
+    }
+    if (total >= options_.min_requests && failures >= options_.error_rate * total) {
+        transition(BreakerState::OPEN);
+    }
+}
+
+void CircuitBreaker::release(uint64_t probe)
+{
+    if (!options_.enabled || probe == 0) {
+        return;
+    }
+    // 只归还本轮的名额; 进入下一轮时计数已经清零
+    uint64_t probes = probes_.load(std::memory_order_acquire);
+    do {
+        if (round_of(probes) != probe || count_of(probes) == 0) {
+            return;
+        }
+    } while (!probes_.compare_exchange_weak(probes, probes - 1, std::memory_order_acq_rel));
+}
+
+void CircuitBreaker::transition(BreakerState to)
+{
+    WAR("Circuit breaker of {}: {} -> {}", name_, to_string(state_.load(std::memory_order_relaxed)), to_string(to));
+    switch (to) {
+        case BreakerState::OPEN:
+            open_until_.store((clock::now() + options_.open_duration).time_since_epoch().count(),
+                              std::memory_order_relaxed);
+            // 名额占满, 半开时放行到一半的 allow 不会再占到名额
+            probes_.store((round_of(probes_.load(std::memory_order_relaxed)) << 32) | options_.probes,
+                          std::memory_order_release);
+            opened_.fetch_add(1, std::memory_order_relaxed);
+            break;
+        case BreakerState::HALF_OPEN: {
+            probe_successes_ = 0;
+            uint64_t round = round_of(probes_.load(std::memory_order_relaxed)) + 1;
+            probes_.store((round & 0xffffffff ? round : 1) << 32, std::memory_order_release);
+            half_opened_.fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+        case BreakerState::CLOSED:
+            reset_window();
+            closed_.fetch_add(1, std::memory_order_relaxed);
+            break;
+    }
+    state_.store(to, std::memory_order_release);
+}
+
+void CircuitBreaker::reset_window()
+{
+    std::fill(window_.begin(), window_.end(), Bucket{});
+}
+
+int64_t CircuitBreaker::epoch(clock::time_point now) const
+{
+    return now.time_since_epoch() / bucket_length_;
+}
+
+} // namespace net
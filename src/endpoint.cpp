@@ -0,0 +1,147 @@
+#include "../include/endpoint.h"
+#include <arpa/inet.h>
+#include <cstring>
+#include <ifaddrs.h>
+#include <netinet/in.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace net
+{
+
+bool is_unix_endpoint(const std::string& endpoint)
+{
+    return endpoint.compare(0, sizeof(UNIX_ENDPOINT_PREFIX) - 1, UNIX_ENDPOINT_PREFIX) == 0;
+}
+
+std::string unix_endpoint_path(const std::string& endpoint)
+{
+    if (!is_unix_endpoint(endpoint)) {
+        return "";
+    }
+    return endpoint.substr(sizeof(UNIX_ENDPOINT_PREFIX) - 1);
+}
+
+bool split_endpoint(const std::string& endpoint, std::string& host, std::string& port)
+{
+    if (is_unix_endpoint(endpoint)) {
+        if (unix_endpoint_path(endpoint).empty()) {
+            return false;
+        }
+        host = endpoint;
+        port.clear();
+        return true;
+    }
+
+    size_t pos = endpoint.rfind(':');
+    if (pos == std::string::npos || pos == 0 || pos + 1 == endpoint.size()) {
+        return false;
+    }
+    host = endpoint.substr(0, pos);
+    port = endpoint.substr(pos + 1);
+    // IPv6 地址写作 "[::1]:8080"
+    if (host.size() > 2 && host.front() == '[' && host.back() == ']') {
+        host = host.substr(1, host.size() - 2);
+    }
+    return true;
+}
+
+std::vector<std::string> split_endpoints(const std::string& published)
+{
+    std::vector<std::string> result;
+    size_t start = 0;
+    while (start <= published.size()) {
+        size_t end = published.find(',', start);
+        if (end == std::string::npos) {
+            end = published.size();
+        }
+        std::string item = published.substr(start, end - start);
+        // 去掉两端的空白
+        size_t first = item.find_first_not_of(" \t");
+        size_t last = item.find_last_not_of(" \t");
+        if (first != std::string::npos) {
+            result.push_back(item.substr(first, last - first + 1));
+        }
+        start = end + 1;
+    }
+    return result;
+}
+
+bool is_local_host(const std::string& host)
+{
+    if (host == "localhost") {
+        return true;
+    }
+
+    char name[256] = { 0 };
+    if (gethostname(name, sizeof(name) - 1) == 0 && host == name) {
+        return true;
+    }
+
+    in_addr v4;
+    in6_addr v6;
+    bool is_v4 = inet_pton(AF_INET, host.c_str(), &v4) == 1;
+    bool is_v6 = !is_v4 && inet_pton(AF_INET6, host.c_str(), &v6) == 1;
+    if (!is_v4 && !is_v6) {
+        return false;
+    }
+    if (is_v4 && (ntohl(v4.s_addr) >> 24) == 127) {
+        return true;
+    }
+    if (is_v6 && IN6_IS_ADDR_LOOPBACK(&v6)) {
+        return true;
+    }
+
+    // 与本机各网卡上的地址比较
+    ifaddrs* addrs = nullptr;
+    if (getifaddrs(&addrs) != 0) {
+        return false;
+    }
+    bool local = false;
+    for (ifaddrs* ifa = addrs; ifa && !local; ifa = ifa->ifa_next) {
+        if (!ifa->ifa_addr) {
+            continue;
+        }
+        if (is_v4 && ifa->ifa_addr->sa_family == AF_INET) {
+            auto* addr = reinterpret_cast<sockaddr_in*>(ifa->ifa_addr);
+            local = addr->sin_addr.s_addr == v4.s_addr;
+        } else if (is_v6 && ifa->ifa_addr->sa_family == AF_INET6) {
+            auto* addr = reinterpret_cast<sockaddr_in6*>(ifa->ifa_addr);
+            local = std::memcmp(&addr->sin6_addr, &v6, sizeof(v6)) == 0;
+        }
+    }
+    freeifaddrs(addrs);
+    return local;
+}
+
+std::string select_endpoint(const std::string& published)
+{
+    std::string tcp;
+    std::string unix_path;
+    for (const std::string& endpoint : split_endpoints(published)) {
+        std::string host, port;
+        if (!split_endpoint(endpoint, host, port)) {
+            continue;
+        }
+        if (is_unix_endpoint(endpoint)) {
+            if (unix_path.empty()) {
+                unix_path = endpoint;
+            }
+        } else if (tcp.empty()) {
+            tcp = endpoint;
+        }
+    }
+
+    if (!unix_path.empty()) {
+        std::string host, port;
+        bool same_host = tcp.empty() || (split_endpoint(tcp, host, port) && is_local_host(host));
+        struct stat st;
+        if (same_host && ::stat(unix_endpoint_path(unix_path).c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+            return unix_path;
+        }
+    }
+    // 只发布了 Unix 域地址时仍然使用它, 连接失败后由调用方重连
+    return tcp.empty() ? unix_path : tcp;
+}
+
+} // namespace net
@@ -0,0 +1,33 @@
+#include "../include/endpoint_load.h"
+#include <algorithm>
+
+namespace net
+{
+
+void EndpointLoad::finish(RpcStatus status, std::chrono::microseconds latency)
+{
+    inflight.fetch_sub(1, std::memory_order_relaxed);
+    if (status != RpcStatus::OK && status != RpcStatus::TIMEOUT) {
+        return;
+    }
+
+    // 第一个样本直接作为平均值; 样本至少记为 1us, 与"没有样本"区分
+    double sample = std::max<double>(static_cast<double>(latency.count()), 1);
+    double current = latency_us.load(std::memory_order_relaxed);
+    double next;
+    do {
+        next = current > 0 ? current + DECAY * (sample - current) : sample;
+    } while (!latency_us.compare_exchange_weak(current, next, std::memory_order_relaxed));
+}
+
+double EndpointLoad::score(double fallback) const
+{
+    double ewma = latency();
+    if (ewma <= 0) {
+        ewma = fallback;
+    }
+    // 加一避免没有延迟样本时得分恒为 0
+    return (ewma + 1) * (inflight.load(std::memory_order_relaxed) + 1);
+}
+
+} // namespace net
@@ -154,8 +154,9 @@ namespace Tools
                 INF("节点删除\nprev value: {} -> current value: {}", 
                     event.prev_kv().as_string(), event.kv().as_string());
                 const std::string& svc_name = parse_key(event.kv().key());
-                const std::string& svr_addr = event.kv().as_string();
-                // 新的服务上线了
+                // 删除事件中当前值为空, 节点地址取删除前的值
+                const std::string& svr_addr = event.prev_kv().as_string();
+                // 服务下线了
                 if(offline_cb_)
                     offline_cb_(svc_name, svr_addr);
             }
@@ -0,0 +1,137 @@
+#include "../include/executor.h"
+
+namespace net
+{
+
+namespace
+{
+    // 当前线程所属的线程池及其在池中的编号, 用于识别工作线程内部的提交
+    thread_local WorkStealingPool* current_pool = nullptr;
+    thread_local size_t current_index = 0;
+}
+
+WorkStealingPool::WorkStealingPool(size_t threads, const std::string& name) :
+    name_(name)
+{
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (size_t i = 0; i < threads; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        threads_.emplace_back([this, i]() { run(i); });
+    }
+    INF("Executor {} started with {} threads", name_, threads);
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    stop();
+}
+
+void WorkStealingPool::submit(Task task)
+{
+    size_t index;
+    if (current_pool == this) {
+        index = current_index;
+    } else {
+        index = next_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+    }
+
+    // 先计数再入队, 保证 pending_ 不小于实际任务数
+    pending_.fetch_add(1);
+    {
+        Worker& worker = *workers_[index];
+        std::lock_guard<std::mutex> lock(worker.mtx);
+        worker.tasks.push_back(std::move(task));
+    }
+
+    // 与 run() 中的 sleeping_/pending_ 检查配对, 两侧都是顺序一致的原子操作,
+    // 保证要么工作线程看到新任务, 要么这里看到有线程在休眠
+    if (sleeping_.load() > 0) {
+        std::lock_guard<std::mutex> lock(sleep_mtx_);
+        sleep_cv_.notify_one();
+    }
+}
+
+void WorkStealingPool::stop()
+{
+    if (stopped_.exchange(true)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleep_mtx_);
+        sleep_cv_.notify_all();
+    }
+    for (auto& thread : threads_) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    INF("Executor {} stopped", name_);
+}
+
+bool WorkStealingPool::pop_local(size_t index, Task& task)
+{
+    Worker& worker = *workers_[index];
+    std::lock_guard<std::mutex> lock(worker.mtx);
+    if (worker.tasks.empty()) {
+        return false;
+    }
+    task = std::move(worker.tasks.back());
+    worker.tasks.pop_back();
+    return true;
+}
+
+bool WorkStealingPool::steal(size_t thief, Task& task)
+{
+    size_t n = workers_.size();
+    for (size_t i = 1; i < n; ++i) {
+        Worker& victim = *workers_[(thief + i) % n];
+        std::unique_lock<std::mutex> lock(victim.mtx, std::try_to_lock);
+        if (!lock.owns_lock() || victim.tasks.empty()) {
+            continue;
+        }
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        return true;
+    }
+    return false;
+}
+
+void WorkStealingPool::run(size_t index)
+{
+    current_pool = this;
+    current_index = index;
+
+    while (true) {
+        Task task;
+        if (pop_local(index, task) || steal(index, task)) {
+            pending_.fetch_sub(1);
+            try {
+                task();
+            } catch (const std::exception& e) {
+                ERR("Executor {} task error: {}", name_, e.what());
+            }
+            continue;
+        }
+
+        // 已停止且队列都已取空时退出
+        if (stopped_.load() && pending_.load() == 0) {
+            break;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mtx_);
+        sleeping_.fetch_add(1);
+        sleep_cv_.wait(lock, [this]() {
+            return pending_.load() > 0 || stopped_.load();
+        });
+        sleeping_.fetch_sub(1);
+    }
+
+    current_pool = nullptr;
+}
+
+} // namespace net
@@ -0,0 +1,65 @@
+#include "../include/hedge.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace net
+{
+
+void LatencyWindow::record(std::chrono::microseconds latency)
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    samples_[count_++ % SIZE] = latency.count();
+    ++stale_;
+}
+
+std::chrono::microseconds LatencyWindow::percentile(double p)
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (count_ < MIN_SAMPLES) {
+        return std::chrono::microseconds(0);
+    }
+    if (p != cached_p_ || stale_ >= RECOMPUTE) {
+        size_t n = std::min(count_, SIZE);
+        std::vector<int64_t> sorted(samples_.begin(), samples_.begin() + n);
+        size_t rank = static_cast<size_t>(std::ceil(p * n));
+        size_t k = rank ? std::min(n, rank) - 1 : 0;
+        std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+        cached_ = sorted[k];
+        cached_p_ = p;
+        stale_ = 0;
+    }
+    return std::chrono::microseconds(cached_);
+}
+
+RateLimiter::RateLimiter(uint32_t per_second) :
+    rate_(per_second),
+    tokens_(per_second),
+    last_(std::chrono::steady_clock::now())
+{
+}
+
+bool RateLimiter::try_acquire()
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto now = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed = now - last_;
+    last_ = now;
+    tokens_ = std::min(rate_, tokens_ + elapsed.count() * rate_);
+    if (tokens_ < 1) {
+        return false;
+    }
+    tokens_ -= 1;
+    return true;
+}
+
+std::chrono::microseconds HedgeState::delay()
+{
+    auto p = latency.percentile(policy.percentile);
+    if (p.count() == 0) {
+        return p;
+    }
+    return std::max(p, std::chrono::duration_cast<std::chrono::microseconds>(policy.min_delay));
+}
+
+} // namespace net
@@ -0,0 +1,196 @@
+#include "../include/iobuf.h"
+#include "../include/buffer_pool.h"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace net
+{
+
+// IOBlock 实现
+IOBlock* IOBlock::create(size_t capacity)
+{
+    IOBlock* block = new IOBlock();
+    block->data_ = BufferPool::instance().allocate(capacity);
+    block->capacity_ = capacity;
+    block->pooled_ = true;
+    return block;
+}
+
+IOBlock* IOBlock::adopt(std::string data)
+{
+    IOBlock* block = new IOBlock();
+    block->owned_ = std::move(data);
+    block->data_ = block->owned_.data();
+    block->capacity_ = block->owned_.size();
+    return block;
+}
+
+IOBlock::~IOBlock()
+{
+    if (pooled_) {
+        BufferPool::instance().deallocate(data_, capacity_);
+    }
+}
+
+void IOBlock::release()
+{
+    if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete this;
+    }
+}
+
+// IOBuf 实现
+IOBuf& IOBuf::operator=(const IOBuf& other)
+{
+    if (this != &other) {
+        IOBuf copy(other);
+        swap(copy);
+    }
+    return *this;
+}
+
+IOBuf::IOBuf(IOBuf&& other) noexcept :
+    slices_(std::move(other.slices_)),
+    size_(std::exchange(other.size_, 0))
+{
+    other.slices_.clear();
+}
+
+IOBuf& IOBuf::operator=(IOBuf&& other) noexcept
+{
+    if (this != &other) {
+        clear();
+        swap(other);
+    }
+    return *this;
+}
+
+void IOBuf::append(IOBlock* block, size_t offset, size_t length)
+{
+    if (length == 0) {
+        return;
+    }
+    block->add_ref();
+    slices_.push_back({ block, offset, length });
+    size_ += length;
+}
+
+void IOBuf::append(const IOBuf& other)
+{
+    // other 可能就是自身, 先固定切片数
+    size_t n = other.slices_.size();
+    slices_.reserve(slices_.size() + n);
+    for (size_t i = 0; i < n; ++i) {
+        const Slice slice = other.slices_[i];
+        append(slice.block, slice.offset, slice.length);
+    }
+}
+
+void IOBuf::append(IOBuf&& other)
+{
+    if (this == &other) {
+        append(static_cast<const IOBuf&>(other));
+        return;
+    }
+    if (slices_.empty()) {
+        swap(other);
+        return;
+    }
+    slices_.insert(slices_.end(), other.slices_.begin(), other.slices_.end());
+    size_ += other.size_;
+    other.slices_.clear();
+    other.size_ = 0;
+}
+
+void IOBuf::append(std::string data)
+{
+    if (data.empty()) {
+        return;
+    }
+    size_t length = data.size();
+    slices_.push_back({ IOBlock::adopt(std::move(data)), 0, length });
+    size_ += length;
+}
+
+void IOBuf::append(const char* data, size_t size)
+{
+    if (size == 0) {
+        return;
+    }
+    IOBlock* block = IOBlock::create(size);
+    std::memcpy(block->data(), data, size);
+    slices_.push_back({ block, 0, size });
+    size_ += size;
+}
+
+void IOBuf::pop_front(size_t n)
+{
+    n = std::min(n, size_);
+    size_ -= n;
+
+    size_t drop = 0;
+    while (n > 0) {
+        Slice& slice = slices_[drop];
+        if (slice.length > n) {
+            slice.offset += n;
+            slice.length -= n;
+            break;
+        }
+        n -= slice.length;
+        slice.block->release();
+        ++drop;
+    }
+    slices_.erase(slices_.begin(), slices_.begin() + drop);
+}
+
+size_t IOBuf::cut(IOBuf* out, size_t n)
+{
+    n = std::min(n, size_);
+    size_t left = n;
+    for (const Slice& slice : slices_) {
+        if (left == 0) {
+            break;
+        }
+        size_t length = std::min(left, slice.length);
+        out->append(slice.block, slice.offset, length);
+        left -= length;
+    }
+    pop_front(n);
+    return n;
+}
+
+void IOBuf::clear()
+{
+    for (Slice& slice : slices_) {
+        slice.block->release();
+    }
+    slices_.clear();
+    size_ = 0;
+}
+
+void IOBuf::swap(IOBuf& other) noexcept
+{
+    slices_.swap(other.slices_);
+    std::swap(size_, other.size_);
+}
+
+std::string_view IOBuf::view() const
+{
+    if (slices_.size() != 1) {
+        return std::string_view();
+    }
+    return std::string_view(slices_[0].data(), slices_[0].length);
+}
+
+std::string IOBuf::to_string() const
+{
+    std::string result;
+    result.reserve(size_);
+    for (const Slice& slice : slices_) {
+        result.append(slice.data(), slice.length);
+    }
+    return result;
+}
+
+} // namespace net
@@ -0,0 +1,56 @@
+#include "../include/local_registry.h"
+#include "../include/log.h"
+#include <mutex>
+
+namespace net
+{
+
+LocalRegistry& LocalRegistry::instance()
+{
+    static LocalRegistry registry;
+    return registry;
+}
+
+void LocalRegistry::add(const std::string& service, const void* owner,
+                        std::unordered_map<std::string, LocalMethod> methods)
+{
+    std::unique_lock<std::shared_mutex> lock(mtx_);
+    auto it = services_.find(service);
+    if (it != services_.end() && it->second.owner != owner) {
+        WAR("Local service {} already registered, overwrite it", service);
+    }
+    services_[service] = Entry{ owner, std::move(methods) };
+    size_.store(services_.size(), std::memory_order_release);
+}
+
+void LocalRegistry::remove(const std::string& service, const void* owner)
+{
+    std::unique_lock<std::shared_mutex> lock(mtx_);
+    auto it = services_.find(service);
+    if (it == services_.end() || it->second.owner != owner) {
+        return;
+    }
+    services_.erase(it);
+    size_.store(services_.size(), std::memory_order_release);
+}
+
+bool LocalRegistry::find(const std::string& service, const std::string& method, LocalMethod& result)
+{
+    if (size_.load(std::memory_order_acquire) == 0) {
+        return false;
+    }
+
+    std::shared_lock<std::shared_mutex> lock(mtx_);
+    auto it = services_.find(service);
+    if (it == services_.end()) {
+        return false;
+    }
+    auto method_it = it->second.methods.find(method);
+    if (method_it == it->second.methods.end()) {
+        return false;
+    }
+    result = method_it->second;
+    return true;
+}
+
+} // namespace net
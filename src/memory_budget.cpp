@@ -0,0 +1,42 @@
+#include "../include/memory_budget.h"
+
+namespace net
+{
+
+void MemoryBudget::add(MemoryCategory category, size_t bytes)
+{
+    if (bytes == 0) {
+        return;
+    }
+    used_[static_cast<size_t>(category)].fetch_add(bytes, std::memory_order_relaxed);
+    total_.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void MemoryBudget::sub(MemoryCategory category, size_t bytes)
+{
+    if (bytes == 0) {
+        return;
+    }
+    used_[static_cast<size_t>(category)].fetch_sub(bytes, std::memory_order_relaxed);
+    total_.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+bool MemoryBudget::try_acquire(MemoryCategory category, size_t bytes)
+{
+    if (limit_) {
+        // 用 CAS 保证并发申请时总用量不会越过上限
+        size_t total = total_.load(std::memory_order_relaxed);
+        do {
+            if (total + bytes > limit_) {
+                reject();
+                return false;
+            }
+        } while (!total_.compare_exchange_weak(total, total + bytes, std::memory_order_relaxed));
+    } else {
+        total_.fetch_add(bytes, std::memory_order_relaxed);
+    }
+    used_[static_cast<size_t>(category)].fetch_add(bytes, std::memory_order_relaxed);
+    return true;
+}
+
+} // namespace net
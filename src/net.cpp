@@ -1,54 +1,151 @@
 #include "../include/net.h"
 #include <algorithm>
 #include <cstring>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <utility>
 
 namespace net
 {
 
+namespace
+{
+    // 通用端点的可读形式, TCP 端点为 "ip:port", Unix 域端点为 "unix:/path"
+    std::string endpoint_string(const asio::generic::stream_protocol::endpoint& endpoint)
+    {
+        if (endpoint.protocol().family() == AF_UNIX) {
+            asio::local::stream_protocol::endpoint local;
+            std::memcpy(local.data(), endpoint.data(), endpoint.size());
+            local.resize(endpoint.size());
+            return UNIX_ENDPOINT_PREFIX + local.path();
+        }
+        ip::tcp::endpoint tcp;
+        size_t size = std::min(endpoint.size(), tcp.capacity());
+        std::memcpy(tcp.data(), endpoint.data(), size);
+        tcp.resize(size);
+        return tcp.address().to_string() + ":" + std::to_string(tcp.port());
+    }
+}
+
 // Buffer 实现
-Buffer::Buffer(size_t size) : buffer_(size) {}
+Buffer::Buffer(size_t size)
+{
+    resize(size);
+}
+
+Buffer::~Buffer()
+{
+    release();
+}
+
+Buffer::Buffer(Buffer&& other) noexcept :
+    block_(std::exchange(other.block_, nullptr)),
+    data_(std::exchange(other.data_, nullptr)),
+    capacity_(std::exchange(other.capacity_, 0)),
+    read_pos_(std::exchange(other.read_pos_, 0)),
+    write_pos_(std::exchange(other.write_pos_, 0))
+{
+}
+
+Buffer& Buffer::operator=(Buffer&& other) noexcept
+{
+    if (this != &other) {
+        release();
+        block_ = std::exchange(other.block_, nullptr);
+        data_ = std::exchange(other.data_, nullptr);
+        capacity_ = std::exchange(other.capacity_, 0);
+        read_pos_ = std::exchange(other.read_pos_, 0);
+        write_pos_ = std::exchange(other.write_pos_, 0);
+    }
+    return *this;
+}
+
+void Buffer::release()
+{
+    if (block_) {
+        block_->release();
+    }
+    block_ = nullptr;
+    data_ = nullptr;
+    capacity_ = 0;
+    read_pos_ = 0;
+    write_pos_ = 0;
+}
+
+IOBuf Buffer::slice(const char* data, size_t size)
+{
+    IOBuf buf;
+    buf.append(block_, data - data_, size);
+    return buf;
+}
+
+void Buffer::reallocate(size_t size)
+{
+    size_t data_size = readable_size();
+    IOBlock* block = IOBlock::create(size);
+    if (data_size > 0) {
+        std::memcpy(block->data(), data_ + read_pos_, data_size);
+    }
+    if (block_) {
+        block_->release();
+    }
+    block_ = block;
+    data_ = block->data();
+    capacity_ = block->capacity();
+    read_pos_ = 0;
+    write_pos_ = data_size;
+}
+
+void Buffer::rewind()
+{
+    if (block_ && block_->shared()) {
+        read_pos_ = write_pos_;
+        return;
+    }
+    read_pos_ = 0;
+    write_pos_ = 0;
+}
 
 std::string Buffer::read_as_string(size_t size)
 {
     size = std::min(size, readable_size());
-    std::string result(buffer_.data() + read_pos_, size);
+    std::string result(data_ + read_pos_, size);
     read_pos_ += size;
 
     // 如果所有数据都已读取，重置位置
     if (read_pos_ == write_pos_) {
-        read_pos_ = 0;
-        write_pos_ = 0;
+        rewind();
     }
 
     return result;
 }
 
-size_t Buffer::capacity() const { return buffer_.size(); }
+size_t Buffer::capacity() const { return capacity_; }
 
 void Buffer::resize(size_t size) 
 { 
-    if (size > buffer_.size()) {
-        buffer_.resize(size);
+    if (size > capacity_) {
+        reallocate(size);
     }
 }
 
 void Buffer::ensure_capacity(size_t required_size) {
-    if (writable_size() < required_size) {
-        // 先尝试移动数据到开头
-        if (read_pos_ > 0) {
-            size_t data_size = readable_size();
-            if (data_size > 0) {
-                std::memmove(buffer_.data(), buffer_.data() + read_pos_, data_size);
-            }
-            read_pos_ = 0;
-            write_pos_ = data_size;
-        }
+    if (writable_size() >= required_size) {
+        return;
+    }
 
-        // 如果仍然不够空间，则扩容
-        if (writable_size() < required_size) {
-            size_t new_size = std::max(buffer_.size() * 2, write_pos_ + required_size);
-            buffer_.resize(new_size);
+    size_t data_size = readable_size();
+    bool fits = capacity_ - data_size >= required_size;
+    if (fits && !block_->shared()) {
+        // 把数据移动到开头即可腾出足够空间
+        if (data_size > 0) {
+            std::memmove(data_, data_ + read_pos_, data_size);
         }
+        read_pos_ = 0;
+        write_pos_ = data_size;
+    } else {
+        // 扩容, 或者块仍被切片引用时换一个同样大小的新块, 只搬移未读的数据
+        reallocate(fits ? capacity_ : std::max(capacity_ * 2, data_size + required_size));
     }
 }
 
@@ -67,24 +164,24 @@ void Buffer::append(const char* data, size_t size)
     if (size == 0) return;
     
     ensure_capacity(size);
-    std::copy(data, data + size, buffer_.data() + write_pos_);
+    std::memcpy(data_ + write_pos_, data, size);
     write_pos_ += size;
 }
 
 void Buffer::clear()
 {
-    read_pos_ = 0;
-    write_pos_ = 0;
+    read_pos_ = write_pos_;
+    rewind();
 }
 
 bool Buffer::empty() const { return readable_size() == 0; }
 
-char* Buffer::write_data() { return buffer_.data() + write_pos_; }
+char* Buffer::write_data() { return data_ + write_pos_; }
 
-const char* Buffer::read_data() const { return buffer_.data() + read_pos_; }
+const char* Buffer::read_data() const { return data_ + read_pos_; }
 
 size_t Buffer::writable_size() const {
-    return buffer_.size() - write_pos_;
+    return capacity_ - write_pos_;
 }
 
 size_t Buffer::readable_size() const {
@@ -98,29 +195,88 @@ void Buffer::advance_write(size_t size) {
 void Buffer::advance_read(size_t size) {
     read_pos_ += size;
     if (read_pos_ == write_pos_) {
-        read_pos_ = 0;
-        write_pos_ = 0;
+        rewind();
     }
 }
 
 // Session 实现
 Session::Session(asio::io_context& io_context,
-                 ip::tcp::socket socket,
+                 StreamSocket socket,
                  OnMsgCallback on_msg_callback) :
+    ioc_(io_context),
     socket_(std::move(socket)),
     cb_(std::move(on_msg_callback))
 {
     read_.resize(8192); // 初始8KB缓冲区
 }
 
+Session::Session(asio::io_context& io_context,
+                 int fd,
+                 OnMsgCallback on_msg_callback) :
+    ioc_(io_context),
+    socket_(io_context),
+    cb_(std::move(on_msg_callback)),
+    uring_fd_(fd)
+{
+    read_.resize(8192);
+}
+
+Session::~Session()
+{
+    if (budget_) {
+        budget_->sub(MemoryCategory::RECV_BUFFER, budget_recv_);
+        budget_->sub(MemoryCategory::RESPONSE, budget_send_);
+    }
+}
+
 void Session::start()
 {
-    INF("Session started with remote: {}", 
-        socket_.remote_endpoint().address().to_string());
-    do_read();
+    last_active_ = std::chrono::steady_clock::now();
+    if (limits_.idle_timeout.count() > 0) {
+        std::weak_ptr<Session> weak = shared_from_this();
+        timer_wheel(ioc_).add(limits_.idle_timeout, [weak]() {
+            if (auto self = weak.lock()) {
+                self->check_idle();
+            }
+        });
+    }
+
+    UringContext* uring = uring_of(ioc_);
+    if (!uring) {
+        INF("Session started with remote: {}", 
+            endpoint_string(socket_.remote_endpoint()));
+        do_read();
+        return;
+    }
+
+#ifdef NET_HAS_IO_URING
+    // 套接字从 asio 中取出, 之后的读写都走 io_uring
+    int fd = uring_fd_.load();
+    if (fd < 0) {
+        fd = socket_.release();
+        uring_fd_ = fd;
+    }
+    INF("Session started on io_uring, fd: {}", fd);
+
+    UringStream::Callbacks callbacks;
+    callbacks.on_data = [this]() { on_read(read_); };
+    callbacks.on_write = [this](int err) {
+        on_written(boost::system::error_code(err, boost::system::system_category()));
+    };
+    callbacks.on_eof = []() {};
+    stream_ = std::make_unique<UringStream>(*uring, fd, read_, std::move(callbacks));
+    stream_->start(shared_from_this());
+#endif
 }
 
 void Session::close() {
+    // io_uring 模式下只关闭读写两端, 在途操作结束后套接字随会话一起释放
+    int fd = uring_fd_.load();
+    if (fd >= 0) {
+        ::shutdown(fd, SHUT_RDWR);
+        return;
+    }
+
     boost::system::error_code ec;
     socket_.close(ec);
     if (ec) {
@@ -128,14 +284,50 @@ void Session::close() {
     }
 }
 
+void Session::send(IOBuf data) {
+    // 已在 io 线程中, 直接进入发送队列
+    if (ioc_.get_executor().running_in_this_thread()) {
+        write_queue_.append(std::move(data));
+        if (!write_queue_.empty() && writing_.empty()) {
+            do_write();
+        }
+        update_flow();
+        return;
+    }
+
+    // 队列由空变为非空时才需要唤醒 io 线程, 之后的数据由同一次唤醒批量取走
+    if (outbox_.push(std::move(data))) {
+        asio::post(ioc_, [self = shared_from_this()]() {
+            self->flush_outbox();
+        });
+    }
+}
+
+void Session::flush_outbox() {
+    outbox_.consume_all([this](IOBuf&& data) {
+        write_queue_.append(std::move(data));
+    });
+    if (!write_queue_.empty() && writing_.empty()) {
+        do_write();
+    }
+    update_flow();
+}
+
+void Session::finish_request(IOBuf data) {
+    inflight_.fetch_sub(1, std::memory_order_relaxed);
+    send(std::move(data));
+}
+
 void Session::do_read() {
     auto self = shared_from_this();
     
     read_.ensure_capacity(1024); // 确保有足够空间
+    reading_ = true;
     
     socket_.async_read_some(
         asio::buffer(read_.write_data(), read_.writable_size()),
         [this, self](boost::system::error_code ec, std::size_t n) {
+            reading_ = false;
             if (ec) {
                 if (ec != asio::error::eof && ec != asio::error::operation_aborted) {
                     ERR("Session read error: {}", ec.message());
@@ -145,59 +337,328 @@ void Session::do_read() {
 
             INF("Session read size: {}", n);
             read_.advance_write(n);
+            on_read(read_);
 
-            // 处理消息
-            Buffer send_buf;
-            if (cb_) {
-                try {
-                    cb_(read_, &send_buf);
-                } catch (const std::exception& e) {
-                    ERR("Message callback error: {}", e.what());
-                }
+            // 读操作始终保持挂起, 不等待写完成; 流量控制暂停期间由 resume_read 重新发起
+            if (!read_paused_ && socket_.is_open()) {
+                do_read();
             }
+        });
+}
 
-            // 如果有响应数据，发送回去
-            if (send_buf.readable_size() > 0) {
-                do_write(send_buf.read_all_as_string());
-            } else {
-                // 继续读取下一条消息
-                do_read();
+void Session::on_read(Buffer& recv, bool replay) {
+    if (evicted_) {
+        recv.clear();
+        return;
+    }
+    // 接收缓冲区可能在读取时扩容, 先计入预算再处理请求
+    update_budget();
+    if (!replay) {
+        received_at_ = std::chrono::steady_clock::now();
+        last_active_ = received_at_;
+    }
+
+    // 处理消息, 响应直接追加到发送队列
+    if (cb_) {
+        try {
+            cb_(shared_from_this(), recv, &write_queue_);
+        } catch (const std::exception& e) {
+            ERR("Message callback error: {}", e.what());
+        }
+    }
+
+    // 缓冲区中剩下的是不完整的帧, 超过上限说明对端发送了过大的帧; 过载时剩下的是暂缓处理的帧
+    if (limits_.max_inbound_bytes && !overloaded() && recv.readable_size() > limits_.max_inbound_bytes) {
+        WAR("Session inbound buffer exceeds {} bytes, close it", limits_.max_inbound_bytes);
+        recv.clear();
+        evicted_ = true;
+        close();
+        return;
+    }
+
+    if (!write_queue_.empty() && writing_.empty()) {
+        do_write();
+    }
+    update_flow();
+}
+
+// 每个会话只挂一个定时器, 收发数据时只更新时间戳, 到期时再按最后活动时间决定关闭还是顺延
+void Session::check_idle() {
+    if (evicted_) {
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    auto idle = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_active_);
+    // 有请求在处理或数据在等待发送时不算空闲
+    bool busy = inflight_.load(std::memory_order_relaxed) > 0 || outbound_size() > 0;
+    if (idle >= limits_.idle_timeout && !busy) {
+        INF("Session idle for {} ms, close it", idle.count());
+        evicted_ = true;
+        close();
+        return;
+    }
+
+    auto delay = busy ? limits_.idle_timeout : limits_.idle_timeout - idle;
+    std::weak_ptr<Session> weak = shared_from_this();
+    timer_wheel(ioc_).add(delay, [weak]() {
+        if (auto self = weak.lock()) {
+            self->check_idle();
+        }
+    });
+}
+
+bool Session::overloaded() const {
+    return (limits_.max_inflight && inflight_.load(std::memory_order_relaxed) >= limits_.max_inflight) ||
+        (limits_.max_outbound_bytes && outbound_size() >= limits_.max_outbound_bytes);
+}
+
+size_t Session::outbound_size() const {
+    size_t size = write_queue_.size() + writing_.size();
+    if (shm_) {
+        size += shm_->pending_size();
+    }
+    return size;
+}
+
+void Session::update_budget() {
+    if (!budget_) {
+        return;
+    }
+    // 切换到共享内存后帧在 ShmStream 自己的接收缓冲区中积累
+    size_t recv = read_.capacity();
+    if (shm_) {
+        recv += shm_->recv_capacity();
+    }
+    if (recv != budget_recv_) {
+        budget_->add(MemoryCategory::RECV_BUFFER, recv);
+        budget_->sub(MemoryCategory::RECV_BUFFER, budget_recv_);
+        budget_recv_ = recv;
+    }
+    size_t send = outbound_size();
+    if (send != budget_send_) {
+        budget_->add(MemoryCategory::RESPONSE, send);
+        budget_->sub(MemoryCategory::RESPONSE, budget_send_);
+        budget_send_ = send;
+    }
+}
+
+void Session::update_flow() {
+    update_budget();
+
+    size_t inflight = inflight_.load(std::memory_order_relaxed);
+    size_t outbound = outbound_size();
+    auto low = [this](size_t high) { return static_cast<size_t>(high * limits_.low_watermark); };
+
+    bool over_outbound = limits_.max_outbound_bytes && outbound >= limits_.max_outbound_bytes;
+    if (!read_paused_) {
+        if (overloaded()) {
+            pause_read();
+        }
+    } else if ((!limits_.max_inflight || inflight <= low(limits_.max_inflight)) &&
+               (!limits_.max_outbound_bytes || outbound <= low(limits_.max_outbound_bytes))) {
+        resume_read();
+    }
+
+    // 待发送的数据持续超过上限, 说明对端读取过慢, 到期仍未降下来就断开
+    if (over_outbound == slow_) {
+        return;
+    }
+    slow_ = over_outbound;
+    if (!slow_) {
+        timer_wheel(ioc_).cancel(evict_timer_);
+        evict_timer_ = 0;
+        return;
+    }
+    if (limits_.evict_after.count() <= 0) {
+        return;
+    }
+    evict_timer_ = timer_wheel(ioc_).add(limits_.evict_after, [this, self = shared_from_this()]() {
+        evict_timer_ = 0;
+        if (!slow_) {
+            return;
+        }
+        WAR("Session outbound queue stays above {} bytes for {} ms, evict slow consumer",
+            limits_.max_outbound_bytes, limits_.evict_after.count());
+        write_queue_.clear();
+        evicted_ = true;
+        close();
+    });
+}
+
+void Session::pause_read() {
+    read_paused_ = true;
+    INF("Session pauses reading, inflight: {}, outbound: {} bytes", inflight_.load(), outbound_size());
+    if (shm_) {
+        shm_->pause();
+    }
+#ifdef NET_HAS_IO_URING
+    if (stream_) {
+        stream_->pause();
+    }
+#endif
+}
+
+void Session::resume_read() {
+    read_paused_ = false;
+    INF("Session resumes reading");
+    // 暂停期间留在接收缓冲区中的帧不会再有新数据触发, 单独投递一次处理
+    if (!read_.empty()) {
+        asio::post(ioc_, [this, self = shared_from_this()]() {
+            if (!read_paused_ && !read_.empty()) {
+                on_read(read_, true);
             }
         });
+    }
+    if (shm_) {
+        shm_->resume();
+    }
+#ifdef NET_HAS_IO_URING
+    if (stream_) {
+        stream_->resume(shared_from_this());
+        return;
+    }
+#endif
+    if (uring_fd_.load() < 0 && !reading_ && socket_.is_open()) {
+        do_read();
+    }
+}
+
+bool Session::attach_shm(const std::string& name, const ShmOptions& options) {
+    if (shm_) {
+        return false;
+    }
+    auto segment = ShmSegment::open(name);
+    if (!segment) {
+        return false;
+    }
+    shm_ = std::make_shared<ShmStream>(ioc_, std::move(segment), options,
+        [this](Buffer& recv) { on_read(recv); });
+    shm_->set_flush_callback([this]() { update_flow(); });
+    if (read_paused_) {
+        shm_->pause();
+    }
+    if (!shm_->start()) {
+        shm_.reset();
+        return false;
+    }
+    INF("Session switched to shared memory {}", name);
+    return true;
 }
 
-void Session::do_write(const std::string& data) {
+// 将排队的所有数据组成 const_buffer 序列, 用一次聚集写 (writev) 发出
+void Session::do_write() {
+    // 共享内存的写入是同步的, 放不下的部分由 ShmStream 暂存
+    if (shm_) {
+        shm_->write(std::move(write_queue_));
+        return;
+    }
+
     auto self = shared_from_this();
+    writing_.swap(write_queue_);
+
+#ifdef NET_HAS_IO_URING
+    if (stream_) {
+        stream_->write(writing_, std::move(self));
+        return;
+    }
+#endif
+
+    iov_.clear();
+    for (const auto& slice : writing_.slices()) {
+        iov_.emplace_back(slice.data(), slice.length);
+    }
     
     asio::async_write(
         socket_,
-        asio::buffer(data),
+        iov_,
         [this, self](boost::system::error_code ec, std::size_t /*n*/) {
-            if (ec) {
-                ERR("Session write error: {}", ec.message());
-                return;
-            }
-            
-            // 写入完成后继续读取
-            do_read();
+            on_written(ec);
         });
 }
 
+void Session::on_written(const boost::system::error_code& ec) {
+    writing_.clear();
+    last_active_ = std::chrono::steady_clock::now();
+    if (ec) {
+        if (ec != asio::error::operation_aborted) {
+            ERR("Session write error: {}", ec.message());
+        }
+        write_queue_.clear();
+        close();
+        return;
+    }
+
+    if (!write_queue_.empty()) {
+        do_write();
+    }
+    update_flow();
+}
+
 // Server 实现
-Server::Server(asio::io_context& ioc, int port, OnMsgCallback cb) :
+Server::Server(asio::io_context& ioc, int port, OnMsgCallback cb, bool reuse_port) :
     ioc_(ioc),
-    acceptor_(ioc_, ip::tcp::endpoint(ip::tcp::v4(), port)),
+    acceptor_(ioc_),
     cb_(std::move(cb))
 {
+    ip::tcp::endpoint endpoint(ip::tcp::v4(), port);
+    acceptor_.open(endpoint.protocol());
+    acceptor_.set_option(asio::socket_base::reuse_address(true));
+    if (reuse_port) {
+        using reuse_port_option = asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+        acceptor_.set_option(reuse_port_option(true));
+    }
+    acceptor_.bind(endpoint);
+    acceptor_.listen();
+    local_address_ = "port " + std::to_string(port);
+}
+
+Server::Server(asio::io_context& ioc, const std::string& path, OnMsgCallback cb) :
+    ioc_(ioc),
+    acceptor_(ioc_),
+    cb_(std::move(cb)),
+    local_address_(UNIX_ENDPOINT_PREFIX + path),
+    unix_path_(path)
+{
+    // 上次运行遗留的套接字文件会导致 bind 失败
+    ::unlink(path.c_str());
+    asio::local::stream_protocol::endpoint endpoint(path);
+    acceptor_.open(endpoint.protocol());
+    acceptor_.bind(endpoint);
+    acceptor_.listen();
+}
+
+Server::~Server()
+{
+    if (listen_fd_ >= 0) {
+        ::close(listen_fd_);
+    }
+    if (!unix_path_.empty()) {
+        ::unlink(unix_path_.c_str());
+    }
 }
 
 void Server::start()
 {
-    INF("Server started on port: {}", acceptor_.local_endpoint().port());
+    INF("Server started on {}", local_address_);
+    if (UringContext* uring = uring_of(ioc_)) {
+        start_uring(*uring);
+        return;
+    }
     do_accept();
 }
 
 void Server::stop() {
+    if (uring_) {
+        // 在 io 线程中取消多发 accept, 监听套接字在其结束后关闭
+        asio::post(ioc_, [self = shared_from_this()]() {
+#ifdef NET_HAS_IO_URING
+            self->stopping_ = true;
+            self->uring_->cancel(&self->accept_op_);
+#endif
+        });
+        return;
+    }
+
     boost::system::error_code ec;
     acceptor_.close(ec);
     if (ec) {
@@ -205,20 +666,60 @@ void Server::stop() {
     }
 }
 
+void Server::start_uring(UringContext& uring) {
+#ifdef NET_HAS_IO_URING
+    uring_ = &uring;
+    listen_fd_ = acceptor_.release();
+    accept_op_.complete = [this](int res, uint32_t flags) {
+        if (res >= 0) {
+            try {
+                auto session = std::make_shared<Session>(ioc_, res, cb_);
+                session->set_limits(limits_);
+                session->set_memory_budget(budget_);
+                session->start();
+            } catch (const std::exception& e) {
+                ERR("Session creation error: {}", e.what());
+            }
+        } else if (res != -ECANCELED) {
+            ERR("Accept error: {}", strerror(-res));
+        }
+
+        if (flags & IORING_CQE_F_MORE) {
+            return;
+        }
+        if (stopping_) {
+            ::close(listen_fd_);
+            listen_fd_ = -1;
+            return;
+        }
+        // 多发 accept 被内核结束时重新发起
+        uring_->accept_multishot(listen_fd_, &accept_op_, nullptr);
+    };
+    uring_->accept_multishot(listen_fd_, &accept_op_, shared_from_this());
+#else
+    (void)uring;
+#endif
+}
+
 void Server::do_accept() {
     auto self = shared_from_this();
     
     acceptor_.async_accept(
-        [this, self](boost::system::error_code ec, ip::tcp::socket socket) {
+        [this, self](boost::system::error_code ec, StreamSocket socket) {
+            if (ec == asio::error::operation_aborted || !acceptor_.is_open()) {
+                return; // 服务器已停止
+            }
             if (ec) {
                 ERR("Accept error: {}", ec.message());
             } else {
                 try {
                     INF("New connection from: {}", 
-                        socket.remote_endpoint().address().to_string());
+                        endpoint_string(socket.remote_endpoint()));
                         
                     auto session = std::make_shared<Session>(
                         ioc_, std::move(socket), cb_);
+                    session->set_limits(limits_);
+                    session->set_memory_budget(budget_);
                     session->start();
                 } catch (const std::exception& e) {
                     ERR("Session creation error: {}", e.what());
@@ -247,30 +748,90 @@ Client::Client(asio::io_context& ioc,
 
 void Client::start()
 {
+    // Unix 域地址不需要解析
+    if (is_unix_endpoint(host_)) {
+        INF("Client connecting to {}", host_);
+        do_connect({ asio::local::stream_protocol::endpoint(unix_endpoint_path(host_)) });
+        return;
+    }
+
     INF("Client connecting to {}:{}", host_, port_);
     
     resolver_.async_resolve(host_, port_,
-        [this](boost::system::error_code ec, ip::tcp::resolver::results_type results) {
+        [this, self = shared_from_this()](boost::system::error_code ec, ip::tcp::resolver::results_type results) {
             if (ec) {
                 ERR("Resolve error: {}", ec.message());
+                handle_close();
                 return;
             }
-            do_connect(results);
+            std::vector<asio::generic::stream_protocol::endpoint> endpoints;
+            for (const auto& entry : results) {
+                endpoints.emplace_back(entry.endpoint());
+            }
+            do_connect(endpoints);
         });
 }
 
-void Client::send(const std::string& data) {
+void Client::send(IOBuf data) {
     auto self = shared_from_this();
     
-    asio::async_write(socket_, asio::buffer(data),
+    asio::post(ioc_, [this, self, data = std::move(data)]() mutable {
+        write_queue_.append(std::move(data));
+        if (connected_ && writing_.empty()) {
+            do_write();
+        }
+    });
+}
+
+void Client::do_write() {
+    if (shm_active_.load(std::memory_order_relaxed)) {
+        shm_->write(std::move(write_queue_));
+        return;
+    }
+
+    auto self = shared_from_this();
+    writing_.swap(write_queue_);
+
+#ifdef NET_HAS_IO_URING
+    if (stream_) {
+        stream_->write(writing_, std::move(self));
+        return;
+    }
+#endif
+
+    iov_.clear();
+    for (const auto& slice : writing_.slices()) {
+        iov_.emplace_back(slice.data(), slice.length);
+    }
+
+    asio::async_write(socket_, iov_,
         [this, self](boost::system::error_code ec, std::size_t /*n*/) {
-            if (ec) {
-                ERR("Client send error: {}", ec.message());
-            }
+            on_written(ec);
         });
 }
 
+void Client::on_written(const boost::system::error_code& ec) {
+    writing_.clear();
+    if (ec) {
+        ERR("Client send error: {}", ec.message());
+        write_queue_.clear();
+        handle_close();
+        return;
+    }
+
+    if (!write_queue_.empty()) {
+        do_write();
+    }
+}
+
 void Client::close() {
+    // io_uring 模式下只关闭读写两端, 在途的接收随之结束并触发 handle_close
+    int fd = uring_fd_.load();
+    if (fd >= 0) {
+        ::shutdown(fd, SHUT_RDWR);
+        return;
+    }
+
     boost::system::error_code ec;
     socket_.close(ec);
     if (ec) {
@@ -278,23 +839,100 @@ void Client::close() {
     }
 }
 
-void Client::do_connect(const ip::tcp::resolver::results_type& endpoints) {
+std::string Client::create_shm(const ShmOptions& options) {
+    auto segment = ShmSegment::create(options.ring_size);
+    if (!segment) {
+        return "";
+    }
+    shm_ = std::make_shared<ShmStream>(ioc_, std::move(segment), options,
+        [this](Buffer& recv) { on_read(recv); });
+    if (!shm_->start()) {
+        shm_.reset();
+        return "";
+    }
+    return shm_->name();
+}
+
+void Client::use_shm(bool ok) {
+    asio::post(ioc_, [this, self = shared_from_this(), ok]() {
+        if (!shm_ || !connected_) {
+            return;
+        }
+        if (!ok) {
+            WAR("Server refused shared memory, keep using socket to {}:{}", host_, port_);
+            shm_.reset();
+            return;
+        }
+        INF("Client switched to shared memory {}", shm_->name());
+        shm_active_ = true;
+        if (!write_queue_.empty() && writing_.empty()) {
+            do_write();
+        }
+    });
+}
+
+// 关闭连接并通知上层, 只回调一次
+void Client::handle_close() {
+    connected_ = false;
+    shm_active_ = false;
+    shm_.reset();
+    int fd = uring_fd_.load();
+    if (fd >= 0) {
+        ::shutdown(fd, SHUT_RDWR);
+    } else {
+        boost::system::error_code ec;
+        socket_.close(ec);
+    }
+    if (close_cb_) {
+        auto cb = std::move(close_cb_);
+        close_cb_ = nullptr;
+        cb();
+    }
+}
+
+void Client::do_connect(const std::vector<asio::generic::stream_protocol::endpoint>& endpoints) {
     auto self = shared_from_this();
     
     asio::async_connect(socket_, endpoints,
-        [this, self](boost::system::error_code ec, ip::tcp::endpoint) {
+        [this, self](boost::system::error_code ec, const asio::generic::stream_protocol::endpoint&) {
             if (ec) {
                 ERR("Connect error: {}", ec.message());
+                handle_close();
                 return;
             }
             
-            INF("Connected to server: {}:{}", host_, port_);
+            INF("Connected to server: {}", port_.empty() ? host_ : host_ + ":" + port_);
+#ifdef NET_HAS_IO_URING
+            // 连接建立后套接字从 asio 中取出, 之后的读写都走 io_uring
+            if (UringContext* uring = uring_of(ioc_)) {
+                UringStream::Callbacks callbacks;
+                callbacks.on_data = [this]() { on_read(read_); };
+                callbacks.on_write = [this](int err) {
+                    on_written(boost::system::error_code(err, boost::system::system_category()));
+                };
+                callbacks.on_eof = [this]() { handle_close(); };
+                int fd = socket_.release();
+                stream_ = std::make_unique<UringStream>(*uring, fd, read_, std::move(callbacks));
+                uring_fd_ = fd;
+            }
+#endif
+            connected_ = true;
+            if (!write_queue_.empty() && writing_.empty()) {
+                do_write();
+            }
             do_read();
         });
 }
 
 void Client::do_read() {
     auto self = shared_from_this();
+
+#ifdef NET_HAS_IO_URING
+    if (stream_) {
+        stream_->start(std::move(self));
+        return;
+    }
+#endif
     
     read_.ensure_capacity(1024);
     
@@ -305,24 +943,28 @@ void Client::do_read() {
                 if (ec != asio::error::eof && ec != asio::error::operation_aborted) {
                     ERR("Client read error: {}", ec.message());
                 }
+                handle_close();
                 return;
             }
 
             INF("Client read size: {}", n);
             read_.advance_write(n);
-
-            // 处理接收到的消息
-            if (cb_) {
-                try {
-                    cb_(read_);
-                } catch (const std::exception& e) {
-                    ERR("Client message callback error: {}", e.what());
-                }
-            }
+            on_read(read_);
             
             // 继续读取
             do_read();
         });
 }
 
-} // namespace net
\ No newline at end of file
+// 处理接收到的消息
+void Client::on_read(Buffer& recv) {
+    if (cb_) {
+        try {
+            cb_(recv);
+        } catch (const std::exception& e) {
+            ERR("Client message callback error: {}", e.what());
+        }
+    }
+}
+
+} // namespace net
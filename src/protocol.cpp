@@ -1,5 +1,8 @@
 #include "../include/protocol.h"
 
+#include <google/protobuf/io/zero_copy_stream.h>
+#include <charconv>
+#include <cstring>
 #include <sstream>
 #include <iostream>
 
@@ -48,19 +51,17 @@ bool ProtocolTools::deserialize(const char* data, size_t len, Json::Value* val)
         Json::CharReaderBuilder builder;
         std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
         
-        std::string json_str(data, len);
         std::string errors;
-        
-        return reader->parse(json_str.c_str(), json_str.c_str() + json_str.size(), val, &errors);
+        return reader->parse(data, data + len, val, &errors);
     } catch (const std::exception& e) {
         std::cerr << "JSON deserialization failed: " << e.what() << std::endl;
         return false;
     }
 }
 
-// 反序列化 Protobuf
+// 反序列化 Protobuf, 所有字段都是默认值的消息序列化后长度为 0, 同样是合法的
 bool ProtocolTools::deserialize(const char* data, size_t len, google::protobuf::Message* msg) {
-    if (!data || !msg || len == 0) {
+    if ((!data && len > 0) || !msg) {
         return false;
     }
     
@@ -72,6 +73,73 @@ bool ProtocolTools::deserialize(const char* data, size_t len, google::protobuf::
     }
 }
 
+namespace
+{
+    // 按切片顺序读取 IOBuf 的输入流
+    class IOBufInputStream : public google::protobuf::io::ZeroCopyInputStream
+    {
+    public:
+        explicit IOBufInputStream(const net::IOBuf& buf) : slices_(buf.slices()) {}
+
+        bool Next(const void** data, int* size) override {
+            if (index_ == slices_.size()) {
+                return false;
+            }
+            const auto& slice = slices_[index_++];
+            *data = slice.data() + skip_;
+            *size = static_cast<int>(slice.length - skip_);
+            total_ += *size;
+            skip_ = 0;
+            return true;
+        }
+
+        void BackUp(int count) override {
+            --index_;
+            skip_ = slices_[index_].length - count;
+            total_ -= count;
+        }
+
+        bool Skip(int count) override {
+            const void* data;
+            int size;
+            while (count > 0 && Next(&data, &size)) {
+                if (size > count) {
+                    BackUp(size - count);
+                    return true;
+                }
+                count -= size;
+            }
+            return count == 0;
+        }
+
+        int64_t ByteCount() const override { return total_; }
+
+    private:
+        const std::vector<net::IOBuf::Slice>& slices_;
+        size_t index_{ 0 };
+        size_t skip_{ 0 };
+        int64_t total_{ 0 };
+    };
+}
+
+bool ProtocolTools::deserialize(const net::IOBuf& buf, google::protobuf::Message* msg) {
+    if (!msg) {
+        return false;
+    }
+    if (buf.contiguous()) {
+        std::string_view view = buf.view();
+        return deserialize(view.data(), view.size(), msg);
+    }
+
+    try {
+        IOBufInputStream stream(buf);
+        return msg->ParseFromZeroCopyStream(&stream);
+    } catch (const std::exception& e) {
+        std::cerr << "Protobuf deserialization failed: " << e.what() << std::endl;
+        return false;
+    }
+}
+
 // 打包 Protobuf 消息
 bool ProtocolTools::pack_protobuf(const google::protobuf::Message& msg, std::string* packed_data) {
     if (!packed_data) {
@@ -114,127 +182,283 @@ bool ProtocolTools::pack(const LVProtocol& protocol, std::string* packed_data) {
     return true;
 }
 
-// 解析消息头
-bool ProtocolTools::parse_message_header(const std::string& data, size_t& data_start, int& length, ProtocolType& type) {
-    size_t pos = 0;
-    const std::string gap = "\r\n";
-    
+namespace
+{
+    // 网络字节序的读写辅助
+    inline void put_u16(char* out, uint16_t v) {
+        out[0] = static_cast<char>(v >> 8);
+        out[1] = static_cast<char>(v);
+    }
+
+    inline void put_u32(char* out, uint32_t v) {
+        for (int i = 3; i >= 0; --i) {
+            out[i] = static_cast<char>(v);
+            v >>= 8;
+        }
+    }
+
+    inline void put_u64(char* out, uint64_t v) {
+        for (int i = 7; i >= 0; --i) {
+            out[i] = static_cast<char>(v);
+            v >>= 8;
+        }
+    }
+
+    inline uint16_t get_u16(const char* in) {
+        const auto* p = reinterpret_cast<const unsigned char*>(in);
+        return static_cast<uint16_t>((p[0] << 8) | p[1]);
+    }
+
+    inline uint32_t get_u32(const char* in) {
+        const auto* p = reinterpret_cast<const unsigned char*>(in);
+        return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+    }
+
+    inline uint64_t get_u64(const char* in) {
+        return (uint64_t(get_u32(in)) << 32) | get_u32(in + 4);
+    }
+
+    const char GAP[] = "\r\n";
+    const size_t GAP_SIZE = 2;
+
+    // 在 [data, data + len) 中查找分隔符
+    const char* find_gap(const char* data, size_t len) {
+        if (len < GAP_SIZE) return nullptr;
+        const char* end = data + len - 1;
+        for (const char* p = data; p < end; ++p) {
+            p = static_cast<const char*>(std::memchr(p, GAP[0], end - p));
+            if (!p) return nullptr;
+            if (p[1] == GAP[1]) return p;
+        }
+        return nullptr;
+    }
+}
+
+// 二进制帧头编码
+void FrameHeader::encode(char* out) const {
+    put_u16(out, MAGIC);
+    out[2] = static_cast<char>(version);
+    out[3] = static_cast<char>(flags);
+    out[4] = static_cast<char>(codec);
+    out[5] = static_cast<char>(status);
+    put_u16(out + 6, method_length);
+    put_u64(out + 8, request_id);
+    put_u32(out + 16, body_length);
+    if (flags & FLAG_DEADLINE) {
+        put_u32(out + SIZE, timeout_ms);
+    }
+}
+
+// 二进制帧头解码
+ParseResult FrameHeader::decode(const char* data, size_t len, FrameHeader* header) {
+    if (len < SIZE) {
+        // 尽早识别错误的魔数, 不必等到凑齐整个帧头
+        if (len >= 2 && get_u16(data) != MAGIC) return ParseResult::INVALID;
+        return ParseResult::INCOMPLETE;
+    }
+    if (get_u16(data) != MAGIC) {
+        return ParseResult::INVALID;
+    }
+
+    header->version = static_cast<uint8_t>(data[2]);
+    header->flags = static_cast<uint8_t>(data[3]);
+    uint8_t codec = static_cast<uint8_t>(data[4]);
+    if (header->version != static_cast<uint8_t>(WireVersion::BINARY) ||
+        codec > static_cast<uint8_t>(ProtocolType::JSON)) {
+        return ParseResult::INVALID;
+    }
+    header->codec = static_cast<ProtocolType>(codec);
+    header->status = static_cast<StatusCode>(data[5]);
+    header->method_length = get_u16(data + 6);
+    header->request_id = get_u64(data + 8);
+    header->body_length = get_u32(data + 16);
+    if (header->body_length > MAX_BODY_LENGTH) {
+        return ParseResult::INVALID;
+    }
+    header->timeout_ms = 0;
+    if (header->flags & FLAG_DEADLINE) {
+        if (len < SIZE + DEADLINE_SIZE) {
+            return ParseResult::INCOMPLETE;
+        }
+        header->timeout_ms = get_u32(data + SIZE);
+    }
+    return ParseResult::OK;
+}
+
+// 解析旧版文本消息头
+ParseResult ProtocolTools::parse_message_header(const char* data, size_t len,
+    size_t& data_start, int& length, ProtocolType& type) {
     // 查找长度字段结束位置
-    size_t len_end = data.find(gap, pos);
-    if (len_end == std::string::npos) {
-        return false;
+    const char* len_end = find_gap(data, len);
+    if (!len_end) {
+        return ParseResult::INCOMPLETE;
     }
-    
+
     // 解析长度
-    std::string len_str = data.substr(pos, len_end - pos);
-    try {
-        length = std::stoi(len_str);
-    } catch (const std::exception&) {
-        return false;
+    auto [ptr, ec] = std::from_chars(data, len_end, length);
+    // 与二进制帧同样限制消息体长度, 否则对端可以让会话为一条消息缓存上 GB 的数据
+    if (ec != std::errc() || ptr != len_end || length < 0 ||
+        static_cast<uint32_t>(length) > FrameHeader::MAX_BODY_LENGTH) {
+        return ParseResult::INVALID;
     }
-    
-    // 移动到类型字段
-    pos = len_end + gap.size();
-    size_t type_end = data.find(gap, pos);
-    if (type_end == std::string::npos) {
-        return false;
+
+    // 解析类型, 固定为两个字节
+    const char* type_begin = len_end + GAP_SIZE;
+    size_t rest = len - (type_begin - data);
+    if (rest < 2 + GAP_SIZE) {
+        return ParseResult::INCOMPLETE;
     }
-    
-    // 解析类型
-    std::string type_str = data.substr(pos, type_end - pos);
-    if (type_str == "PB") {
+    if (type_begin[0] == 'P' && type_begin[1] == 'B') {
         type = ProtocolType::PROTOBUF;
-    } else if (type_str == "JS") {
+    } else if (type_begin[0] == 'J' && type_begin[1] == 'S') {
         type = ProtocolType::JSON;
     } else {
-        return false;
+        return ParseResult::INVALID;
     }
-    
+    if (std::memcmp(type_begin + 2, GAP, GAP_SIZE) != 0) {
+        return ParseResult::INVALID;
+    }
+
     // 计算数据开始位置
-    data_start = type_end + gap.size();
-    return true;
+    data_start = (type_begin - data) + 2 + GAP_SIZE;
+    return ParseResult::OK;
 }
 
-// 查找完整消息的结束位置
-bool ProtocolTools::find_complete_message(const std::string& data, size_t& message_end) {
-    size_t data_start;
-    int length;
-    ProtocolType type;
-    
-    if (!parse_message_header(data, data_start, length, type)) {
-        return false;
+ParseResult ProtocolTools::parse_frame(const char* data, size_t len,
+    FrameView& frame, size_t& frame_end) {
+    if (len == 0) {
+        return ParseResult::INCOMPLETE;
     }
-    
-    // 检查数据长度是否足够
-    const std::string gap = "\r\n";
-    size_t expected_end = data_start + length + gap.size();
-    
-    if (expected_end > data.size()) {
-        return false; // 数据不完整
+
+    // 旧版文本帧以长度的十进制数字开头
+    if (data[0] >= '0' && data[0] <= '9') {
+        size_t data_start;
+        int length;
+        ProtocolType type;
+        ParseResult res = parse_message_header(data, len, data_start, length, type);
+        if (res != ParseResult::OK) {
+            return res;
+        }
+
+        // 检查数据长度是否足够
+        size_t expected_end = data_start + length + GAP_SIZE;
+        if (expected_end > len) {
+            return ParseResult::INCOMPLETE;
+        }
+
+        // 验证结束分隔符
+        if (std::memcmp(data + data_start + length, GAP, GAP_SIZE) != 0) {
+            return ParseResult::INVALID;
+        }
+
+        frame.version = WireVersion::TEXT;
+        frame.type = type;
+        frame.flags = 0;
+        frame.status = StatusCode::OK;
+        frame.request_id = 0;
+        frame.timeout_ms = 0;
+        frame.method = std::string_view();
+        frame.body = std::string_view(data + data_start, length);
+        frame_end = expected_end;
+        return ParseResult::OK;
     }
-    
-    // 验证结束分隔符
-    if (data.substr(data_start + length, gap.size()) != gap) {
-        return false; // 格式错误
+
+    FrameHeader header;
+    ParseResult res = FrameHeader::decode(data, len, &header);
+    if (res != ParseResult::OK) {
+        return res;
     }
-    
-    message_end = expected_end;
-    return true;
+    size_t method_start = header.length();
+    size_t body_start = method_start + header.method_length;
+    if (body_start + header.body_length > len) {
+        return ParseResult::INCOMPLETE;
+    }
+
+    frame.version = WireVersion::BINARY;
+    frame.type = header.codec;
+    frame.flags = header.flags;
+    frame.status = header.status;
+    frame.request_id = header.request_id;
+    frame.timeout_ms = header.timeout_ms;
+    frame.method = std::string_view(data + method_start, header.method_length);
+    frame.body = std::string_view(data + body_start, header.body_length);
+    frame_end = body_start + header.body_length;
+    return ParseResult::OK;
 }
 
-// 解包数据（处理粘包）
-bool ProtocolTools::unpack(const char* data, size_t len, std::vector<LVProtocol>& messages) {
-    return unpack(std::string(data, len), messages);
+ParseResult ProtocolTools::parse_message(const char* data, size_t len,
+    LVProtocol& message, size_t& message_end) {
+    FrameView frame;
+    ParseResult res = parse_frame(data, len, frame, message_end);
+    if (res != ParseResult::OK) {
+        return res;
+    }
+
+    message.from_frame(frame);
+    return ParseResult::OK;
 }
 
-bool ProtocolTools::unpack(const std::string& data, std::vector<LVProtocol>& messages) {
+// FrameDecoder 实现
+ParseResult FrameDecoder::next(FrameView& frame) {
+    size_t frame_end;
+    ParseResult res = ProtocolTools::parse_frame(data_ + pos_, len_ - pos_, frame, frame_end);
+    if (res == ParseResult::OK) {
+        pos_ += frame_end;
+    }
+    return res;
+}
+
+// 解包数据（处理粘包）
+bool ProtocolTools::unpack(const char* data, size_t len, std::vector<LVProtocol>& messages) {
     messages.clear();
-    size_t pos = 0;
-    
-    while (pos < data.size()) {
-        size_t message_end;
-        
-        if (!find_complete_message(data.substr(pos), message_end)) {
-            break; // 没有找到完整消息
-        }
-        
-        // 提取完整消息
-        std::string complete_message = data.substr(pos, message_end);
-        LVProtocol protocol;
-        
-        if (protocol.from_string(complete_message)) {
-            messages.push_back(protocol);
-        }
-        
-        pos += message_end;
+
+    FrameDecoder decoder(data, len);
+    FrameView frame;
+    while (decoder.next(frame) == ParseResult::OK) {
+        messages.emplace_back().from_frame(frame);
     }
-    
+
     return !messages.empty();
 }
 
+bool ProtocolTools::unpack(const std::string& data, std::vector<LVProtocol>& messages) {
+    return unpack(data.data(), data.size(), messages);
+}
+
 // BufferHandler 实现
 void ProtocolTools::BufferHandler::append(const char* data, size_t len) {
+    // 已消费的前缀超过一半时才整体前移, 摊还后每字节只搬移常数次
+    if (read_pos_ == buffer_.size()) {
+        buffer_.clear();
+        read_pos_ = 0;
+    } else if (read_pos_ > 0 && read_pos_ >= buffer_.size() / 2) {
+        buffer_.erase(0, read_pos_);
+        read_pos_ = 0;
+    }
     buffer_.append(data, len);
 }
 
 void ProtocolTools::BufferHandler::append(const std::string& data) {
-    buffer_.append(data);
+    append(data.data(), data.size());
 }
 
-bool ProtocolTools::BufferHandler::get_next_message(LVProtocol& message) {
-    size_t message_end;
-    
-    if (!find_complete_message(buffer_, message_end)) {
+bool ProtocolTools::BufferHandler::next_frame(FrameView& frame) {
+    size_t frame_end;
+
+    if (parse_frame(buffer_.data() + read_pos_, buffer_.size() - read_pos_, frame, frame_end) != ParseResult::OK) {
         return false; // 没有完整消息
     }
-    
-    // 提取并解析消息
-    std::string complete_message = buffer_.substr(0, message_end);
-    if (!message.from_string(complete_message)) {
+
+    read_pos_ += frame_end;
+    return true;
+}
+
+bool ProtocolTools::BufferHandler::get_next_message(LVProtocol& message) {
+    FrameView frame;
+    if (!next_frame(frame)) {
         return false;
     }
-    
-    // 从缓冲区移除已处理的消息
-    buffer_.erase(0, message_end);
+
+    message.from_frame(frame);
     return true;
-}
\ No newline at end of file
+}
@@ -0,0 +1,55 @@
+#include "../include/retry.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace net
+{
+
+bool RetryPolicy::retryable(RpcStatus status) const
+{
+    return std::find(retry_on.begin(), retry_on.end(), status) != retry_on.end();
+}
+
+std::chrono::milliseconds RetryPolicy::backoff(int attempt) const
+{
+    double cap = static_cast<double>(initial_backoff.count()) * std::pow(multiplier, std::max(attempt - 1, 0));
+    cap = std::min(cap, static_cast<double>(max_backoff.count()));
+    if (cap <= 0) {
+        return std::chrono::milliseconds(0);
+    }
+
+    thread_local std::mt19937_64 rng{ std::random_device{}() };
+    std::uniform_real_distribution<double> dist(0, cap);
+    return std::chrono::milliseconds(static_cast<int64_t>(dist(rng)));
+}
+
+RetryBudget::RetryBudget(double ratio, double max_tokens) :
+    deposit_(static_cast<int64_t>(ratio * SCALE)),
+    max_(static_cast<int64_t>(max_tokens * SCALE)),
+    tokens_(max_)
+{
+}
+
+void RetryBudget::deposit()
+{
+    int64_t tokens = tokens_.load(std::memory_order_relaxed);
+    while (tokens < max_ &&
+           !tokens_.compare_exchange_weak(tokens, std::min(tokens + deposit_, max_), std::memory_order_relaxed)) {
+    }
+}
+
+bool RetryBudget::try_withdraw()
+{
+    int64_t tokens = tokens_.load(std::memory_order_relaxed);
+    do {
+        if (tokens < SCALE) {
+            rejected_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    } while (!tokens_.compare_exchange_weak(tokens, tokens - SCALE, std::memory_order_relaxed));
+    retries_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+} // namespace net
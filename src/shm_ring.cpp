@@ -0,0 +1,399 @@
+#include "../include/shm_ring.h"
+#include "../include/net.h"
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <random>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+namespace net
+{
+
+namespace
+{
+    constexpr uint32_t SHM_MAGIC = 0x53484d52; // "SHMR"
+    constexpr uint32_t SHM_VERSION = 2;
+    // 段名前缀, 服务端只打开带此前缀的段
+    constexpr const char SHM_NAME_PREFIX[] = "/net-rpc-shm-";
+
+    size_t header_size()
+    {
+        return (sizeof(ShmSegment::Header) + 4095) & ~size_t(4095);
+    }
+
+    size_t round_up_pow2(size_t size)
+    {
+        size_t result = 4096;
+        while (result < size) {
+            result <<= 1;
+        }
+        return result;
+    }
+}
+
+// ShmSegment 实现
+std::unique_ptr<ShmSegment> ShmSegment::create(size_t ring_size)
+{
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory atomics must be lock free");
+
+    std::random_device rd;
+    std::string name = SHM_NAME_PREFIX + std::to_string(getpid()) + "-" + std::to_string(rd()) + std::to_string(rd());
+    ring_size = round_up_pow2(ring_size);
+    size_t length = header_size() + 2 * ring_size;
+
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        ERR("shm_open {} failed: {}", name, strerror(errno));
+        return nullptr;
+    }
+    if (ftruncate(fd, length) != 0) {
+        ERR("ftruncate {} failed: {}", name, strerror(errno));
+        ::close(fd);
+        shm_unlink(name.c_str());
+        return nullptr;
+    }
+    void* addr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        ERR("mmap {} failed: {}", name, strerror(errno));
+        shm_unlink(name.c_str());
+        return nullptr;
+    }
+
+    std::unique_ptr<ShmSegment> segment(new ShmSegment());
+    segment->name_ = name;
+    segment->side_ = 0;
+    segment->owner_ = true;
+    segment->addr_ = addr;
+    segment->length_ = length;
+    segment->ring_size_ = ring_size;
+    segment->header_ = new (addr) Header();
+    segment->header_->ring_size = ring_size;
+    segment->header_->version = SHM_VERSION;
+    // magic 最后写入, 打开方据此确认初始化完成
+    std::atomic_thread_fence(std::memory_order_release);
+    segment->header_->magic = SHM_MAGIC;
+    return segment;
+}
+
+std::unique_ptr<ShmSegment> ShmSegment::open(const std::string& name)
+{
+    if (name.compare(0, sizeof(SHM_NAME_PREFIX) - 1, SHM_NAME_PREFIX) != 0 ||
+        name.find('/', 1) != std::string::npos) {
+        ERR("Refuse to open shared memory {}", name);
+        return nullptr;
+    }
+
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+        ERR("shm_open {} failed: {}", name, strerror(errno));
+        return nullptr;
+    }
+    // 名字只用于握手, 映射后即可删除
+    shm_unlink(name.c_str());
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < header_size()) {
+        ERR("Invalid shared memory {}", name);
+        ::close(fd);
+        return nullptr;
+    }
+    size_t length = st.st_size;
+    void* addr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        ERR("mmap {} failed: {}", name, strerror(errno));
+        return nullptr;
+    }
+
+    std::unique_ptr<ShmSegment> segment(new ShmSegment());
+    segment->name_ = name;
+    segment->side_ = 1;
+    segment->addr_ = addr;
+    segment->length_ = length;
+    segment->header_ = static_cast<Header*>(addr);
+
+    Header* header = segment->header_;
+    size_t ring_size = header->ring_size;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (header->magic != SHM_MAGIC || header->version != SHM_VERSION ||
+        ring_size == 0 || (ring_size & (ring_size - 1)) || header_size() + 2 * ring_size != length) {
+        ERR("Invalid shared memory {}", name);
+        return nullptr;
+    }
+    segment->ring_size_ = ring_size;
+    return segment;
+}
+
+ShmSegment::~ShmSegment()
+{
+    if (addr_) {
+        munmap(addr_, length_);
+    }
+    // 对端没有打开时由创建方删除名字
+    if (owner_) {
+        shm_unlink(name_.c_str());
+    }
+}
+
+std::string ShmSegment::bell_address(int side) const
+{
+    // 抽象命名空间的地址以 '\0' 开头, 不在文件系统中留下痕迹, 套接字关闭时自动释放
+    return std::string(1, '\0') + name_.substr(1) + "-bell" + std::to_string(side);
+}
+
+char* ShmSegment::ring_data(int ring) const
+{
+    return static_cast<char*>(addr_) + header_size() + ring * ring_size_;
+}
+
+// ShmStream 实现
+ShmStream::ShmStream(asio::io_context& ioc, std::unique_ptr<ShmSegment> segment,
+                     const ShmOptions& options, DataCallback on_data) :
+    ioc_(ioc),
+    segment_(std::move(segment)),
+    options_(options),
+    on_data_(std::move(on_data)),
+    rx_(segment_->header()->rings[1 - segment_->side()]),
+    tx_(segment_->header()->rings[segment_->side()]),
+    rx_data_(segment_->ring_data(1 - segment_->side())),
+    tx_data_(segment_->ring_data(segment_->side())),
+    mask_(segment_->ring_size() - 1),
+    bell_(segment_->header()->bells[segment_->side()]),
+    peer_bell_(segment_->header()->bells[1 - segment_->side()]),
+    socket_(ioc),
+    peer_address_(segment_->bell_address(1 - segment_->side())),
+    recv_(std::make_unique<Buffer>(8192))
+{
+    // 单核机器上轮询只会占住对端需要的 CPU
+    if (std::thread::hardware_concurrency() <= 1) {
+        options_.spin = std::chrono::microseconds(0);
+    }
+}
+
+ShmStream::~ShmStream()
+{
+    // 挂起的接收随套接字关闭而结束, 回调只弱引用本对象
+    bell_.sleeping.store(0, std::memory_order_relaxed);
+    boost::system::error_code ec;
+    socket_.close(ec);
+}
+
+bool ShmStream::start()
+{
+    boost::system::error_code ec;
+    socket_.open(asio::local::datagram_protocol(), ec);
+    if (!ec) {
+        socket_.bind(asio::local::datagram_protocol::endpoint(segment_->bell_address(segment_->side())), ec);
+    }
+    if (!ec) {
+        socket_.non_blocking(true, ec);
+    }
+    if (ec) {
+        ERR("Bind doorbell of shared memory {} failed: {}", name(), ec.message());
+        return false;
+    }
+    idle_since_ = clock::now();
+    schedule_poll();
+    return true;
+}
+
+size_t ShmStream::recv_capacity() const
+{
+    return recv_->capacity();
+}
+
+bool ShmStream::ready() const
+{
+    if (!paused_ && rx_.tail.load(std::memory_order_acquire) != rx_.head.load(std::memory_order_relaxed)) {
+        return true;
+    }
+    // 有待发送的数据且环中腾出了空间
+    return !pending_.empty() &&
+        tx_.tail.load(std::memory_order_relaxed) - tx_.head.load(std::memory_order_acquire) < segment_->ring_size();
+}
+
+void ShmStream::schedule_poll()
+{
+    if (posted_) {
+        return;
+    }
+    posted_ = true;
+    std::weak_ptr<ShmStream> weak = weak_from_this();
+    asio::post(ioc_, [weak]() {
+        if (auto self = weak.lock()) {
+            self->posted_ = false;
+            self->poll();
+        }
+    });
+}
+
+// 轮询以重新投递自身的方式进行, 期间 io 线程照常处理其他连接的事件
+void ShmStream::poll()
+{
+    if (ready()) {
+        on_ready();
+        idle_since_ = clock::now();
+    } else if (options_.spin.count() == 0 || clock::now() - idle_since_ >= options_.spin) {
+        sleep();
+        return;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+    schedule_poll();
+}
+
+void ShmStream::sleep()
+{
+    // 先登记睡眠再复查, 与对端 ring_bell 中先发布数据再检查标记配对, 不会错过通知
+    bell_.sleeping.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (ready()) {
+        bell_.sleeping.store(0, std::memory_order_relaxed);
+        schedule_poll();
+        return;
+    }
+    if (waiting_) {
+        return;
+    }
+
+    waiting_ = true;
+    std::weak_ptr<ShmStream> weak = weak_from_this();
+    socket_.async_receive(asio::buffer(bell_buf_), [weak](boost::system::error_code ec, std::size_t /*n*/) {
+        auto self = weak.lock();
+        if (!self || ec == asio::error::operation_aborted) {
+            return;
+        }
+        self->waiting_ = false;
+        self->bell_.sleeping.store(0, std::memory_order_relaxed);
+        // 读走睡眠期间积压的门铃
+        boost::system::error_code drain_ec;
+        while (self->socket_.receive(asio::buffer(self->bell_buf_), 0, drain_ec) > 0 && !drain_ec) {
+        }
+        self->idle_since_ = clock::now();
+        self->poll();
+    });
+}
+
+void ShmStream::ring_bell()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!peer_bell_.sleeping.load(std::memory_order_relaxed)) {
+        return;
+    }
+    // 对端的门铃中已有未读的字节时发送会因缓冲区满失败, 忽略即可
+    static const char byte = 0;
+    boost::system::error_code ec;
+    socket_.send_to(asio::buffer(&byte, 1), peer_address_, 0, ec);
+}
+
+void ShmStream::on_ready()
+{
+    if (!paused_) {
+        drain();
+    }
+    if (!pending_.empty()) {
+        flush();
+        if (on_flush_) {
+            on_flush_();
+        }
+    }
+}
+
+void ShmStream::pause()
+{
+    paused_ = true;
+}
+
+// 暂停期间留在接收缓冲区中的帧不会再有通知, 直接处理一次
+void ShmStream::resume()
+{
+    paused_ = false;
+    std::weak_ptr<ShmStream> weak = weak_from_this();
+    asio::post(ioc_, [weak]() {
+        if (auto self = weak.lock()) {
+            if (!self->paused_) {
+                self->on_ready();
+            }
+            self->idle_since_ = clock::now();
+            self->schedule_poll();
+        }
+    });
+}
+
+void ShmStream::drain()
+{
+    uint64_t head = rx_.head.load(std::memory_order_relaxed);
+    uint64_t tail = rx_.tail.load(std::memory_order_acquire);
+    // 环为空时仍可能有暂停前留在接收缓冲区中未处理的帧
+    if (head == tail && recv_->empty()) {
+        return;
+    }
+
+    if (head != tail) {
+        // 环中的数据可能绕回开头, 分两段拷贝进接收缓冲区
+        size_t size = tail - head;
+        recv_->ensure_capacity(size);
+        size_t offset = head & mask_;
+        size_t first = std::min(size, segment_->ring_size() - offset);
+        std::memcpy(recv_->write_data(), rx_data_ + offset, first);
+        std::memcpy(recv_->write_data() + first, rx_data_, size - first);
+        recv_->advance_write(size);
+        rx_.head.store(tail, std::memory_order_release);
+
+        // 对端在等待空间
+        if (rx_.writer_blocked.exchange(0, std::memory_order_acq_rel)) {
+            ring_bell();
+        }
+    }
+
+    if (on_data_) {
+        on_data_(*recv_);
+    }
+}
+
+void ShmStream::write(IOBuf data)
+{
+    pending_.append(std::move(data));
+    flush();
+}
+
+void ShmStream::flush()
+{
+    while (!pending_.empty()) {
+        uint64_t tail = tx_.tail.load(std::memory_order_relaxed);
+        uint64_t head = tx_.head.load(std::memory_order_acquire);
+        size_t space = segment_->ring_size() - (tail - head);
+        if (space == 0) {
+            // 先登记等待再复查, 避免错过对端读走数据后的通知
+            tx_.writer_blocked.store(1, std::memory_order_seq_cst);
+            if (tx_.head.load(std::memory_order_seq_cst) != head) {
+                continue;
+            }
+            return;
+        }
+
+        size_t written = 0;
+        for (const auto& slice : pending_.slices()) {
+            if (written == space) {
+                break;
+            }
+            size_t n = std::min(slice.length, space - written);
+            size_t offset = (tail + written) & mask_;
+            size_t first = std::min(n, segment_->ring_size() - offset);
+            std::memcpy(tx_data_ + offset, slice.data(), first);
+            std::memcpy(tx_data_, slice.data() + first, n - first);
+            written += n;
+        }
+        tx_.tail.store(tail + written, std::memory_order_release);
+        pending_.pop_front(written);
+        ring_bell();
+    }
+}
+
+} // namespace net
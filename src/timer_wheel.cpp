@@ -0,0 +1,264 @@
+#include "../include/timer_wheel.h"
+
+namespace net
+{
+
+asio::execution_context::id TimerWheel::id;
+
+TimerWheel::TimerWheel(asio::io_context& ioc) :
+    asio::execution_context::service(ioc),
+    ioc_(ioc),
+    timer_(ioc),
+    start_(clock::now())
+{
+    heads_.fill(NIL);
+}
+
+TimerWheel::~TimerWheel() = default;
+
+void TimerWheel::shutdown()
+{
+    stopped_ = true;
+    heads_.fill(NIL);
+    nodes_.clear();
+    free_ = NIL;
+    size_ = 0;
+}
+
+uint64_t TimerWheel::now_tick() const
+{
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now() - start_);
+    return elapsed / TICK;
+}
+
+TimerId TimerWheel::add(std::chrono::milliseconds delay, std::function<void()> cb)
+{
+    return add_at(now() + delay, std::move(cb));
+}
+
+TimerId TimerWheel::add_at(clock::time_point when, std::function<void()> cb)
+{
+    if (stopped_) {
+        return 0;
+    }
+
+    // 时间轮空闲期间没有推进, 先追上当前时间
+    if (size_ == 0) {
+        current_ = now_tick();
+    }
+
+    uint64_t expire = current_ + 1;
+    if (when > start_) {
+        auto ms = std::chrono::ceil<std::chrono::milliseconds>(when - start_);
+        expire = std::max(expire, static_cast<uint64_t>((ms + TICK - std::chrono::milliseconds(1)) / TICK));
+    }
+
+    uint32_t index;
+    if (free_ != NIL) {
+        index = free_;
+        free_ = nodes_[index].next;
+    } else {
+        index = static_cast<uint32_t>(nodes_.size());
+        nodes_.emplace_back();
+    }
+    Node& node = nodes_[index];
+    if (++node.generation == 0) {
+        node.generation = 1;
+    }
+    node.expire = expire;
+    node.active = true;
+    node.cb = std::move(cb);
+    TimerId timer = (static_cast<uint64_t>(node.generation) << 32) | index;
+
+    place(index);
+    ++size_;
+    arm();
+    return timer;
+}
+
+void TimerWheel::cancel(TimerId timer)
+{
+    uint32_t index = static_cast<uint32_t>(timer);
+    uint32_t generation = static_cast<uint32_t>(timer >> 32);
+    if (timer == 0 || index >= nodes_.size()) {
+        return;
+    }
+    Node& node = nodes_[index];
+    if (!node.active || node.generation != generation) {
+        return;
+    }
+    unlink(index);
+    release(index);
+    // 还有定时器时保持原来的唤醒时刻, 唤醒后发现没有到期的定时器即可;
+    // 全部取消后停止等待, 不让空的时间轮拖住 io_context::run 的退出
+    if (size_ == 0 && armed_tick_ != 0) {
+        armed_tick_ = 0;
+        timer_.cancel();
+    }
+}
+
+void TimerWheel::place(uint32_t index)
+{
+    Node& node = nodes_[index];
+    uint64_t diff = node.expire > current_ ? node.expire - current_ : 0;
+
+    size_t level = 0;
+    while (level + 1 < LEVELS && diff >= (uint64_t(1) << (SLOT_BITS * (level + 1)))) {
+        ++level;
+    }
+    // 超出顶层范围的定时器先放在顶层能表示的最远位置, 届时按实际到期刻度重新放置
+    uint64_t expire = node.expire;
+    uint64_t range = uint64_t(1) << (SLOT_BITS * LEVELS);
+    if (diff >= range) {
+        expire = current_ + range - 1;
+    }
+
+    size_t slot = level * SLOTS + ((expire >> (SLOT_BITS * level)) & MASK);
+    node.slot = static_cast<uint16_t>(slot);
+    node.prev = NIL;
+    node.next = heads_[slot];
+    if (node.next != NIL) {
+        nodes_[node.next].prev = index;
+    }
+    heads_[slot] = index;
+}
+
+void TimerWheel::unlink(uint32_t index)
+{
+    Node& node = nodes_[index];
+    if (node.prev != NIL) {
+        nodes_[node.prev].next = node.next;
+    } else {
+        heads_[node.slot] = node.next;
+    }
+    if (node.next != NIL) {
+        nodes_[node.next].prev = node.prev;
+    }
+    node.prev = node.next = NIL;
+}
+
+void TimerWheel::release(uint32_t index)
+{
+    Node& node = nodes_[index];
+    node.active = false;
+    node.cb = nullptr;
+    node.next = free_;
+    free_ = index;
+    --size_;
+}
+
+void TimerWheel::cascade(size_t level, size_t slot)
+{
+    uint32_t index = heads_[level * SLOTS + slot];
+    heads_[level * SLOTS + slot] = NIL;
+    while (index != NIL) {
+        uint32_t next = nodes_[index].next;
+        place(index);
+        index = next;
+    }
+}
+
+uint64_t TimerWheel::next_tick() const
+{
+    uint64_t best = UINT64_MAX;
+    // 第 0 层的槽与接下来的 SLOTS - 1 个刻度一一对应
+    for (uint64_t i = 1; i < SLOTS; ++i) {
+        if (heads_[(current_ + i) & MASK] != NIL) {
+            best = current_ + i;
+            break;
+        }
+    }
+    // 上层的槽在对应的区间开始时重新分配
+    for (size_t level = 1; level < LEVELS; ++level) {
+        size_t shift = SLOT_BITS * level;
+        uint64_t block = current_ >> shift;
+        for (uint64_t i = 1; i <= SLOTS; ++i) {
+            if (heads_[level * SLOTS + ((block + i) & MASK)] != NIL) {
+                best = std::min(best, (block + i) << shift);
+                break;
+            }
+        }
+    }
+    return best;
+}
+
+void TimerWheel::advance()
+{
+    uint64_t now = now_tick();
+    while (current_ < now && size_ > 0) {
+        // 中间的刻度既没有到期的定时器也没有需要重新分配的槽, 直接跳过
+        current_ = std::min(now, next_tick());
+
+        for (size_t level = 1; level < LEVELS; ++level) {
+            size_t shift = SLOT_BITS * level;
+            if (current_ & ((uint64_t(1) << shift) - 1)) {
+                break;
+            }
+            cascade(level, (current_ >> shift) & MASK);
+        }
+
+        // 回调中新加的定时器至少落在下一个刻度, 不会进入这个槽
+        size_t slot = current_ & MASK;
+        while (heads_[slot] != NIL) {
+            uint32_t index = heads_[slot];
+            unlink(index);
+            if (nodes_[index].expire > current_) {
+                place(index);
+                continue;
+            }
+            auto cb = std::move(nodes_[index].cb);
+            release(index);
+            try {
+                cb();
+            } catch (const std::exception& e) {
+                ERR("Timer callback error: {}", e.what());
+            }
+        }
+    }
+    if (size_ == 0) {
+        current_ = now;
+    }
+}
+
+void TimerWheel::arm()
+{
+    if (size_ == 0 || stopped_) {
+        return;
+    }
+    uint64_t tick = next_tick();
+    if (armed_tick_ != 0 && armed_tick_ <= tick) {
+        return;
+    }
+
+    // 重新设置到期时间会取消之前的等待, 被取消的回调直接返回
+    armed_tick_ = tick;
+    timer_.expires_at(start_ + TICK * tick);
+    timer_.async_wait([this](boost::system::error_code ec) {
+        if (ec) {
+            return;
+        }
+        armed_tick_ = 0;
+        advance();
+        arm();
+    });
+}
+
+void TimerWheel::poll()
+{
+    advance();
+    arm();
+}
+
+void TimerWheel::set_time_source(std::function<clock::time_point()> now)
+{
+    now_ = std::move(now);
+    start_ = this->now();
+    current_ = 0;
+}
+
+TimerWheel& timer_wheel(asio::io_context& ioc)
+{
+    return asio::use_service<TimerWheel>(ioc);
+}
+
+} // namespace net
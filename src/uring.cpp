@@ -0,0 +1,556 @@
+#include "../include/uring.h"
+#include "../include/net.h"
+
+#ifdef NET_HAS_IO_URING
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <utility>
+#endif
+
+namespace net
+{
+
+#ifndef NET_HAS_IO_URING
+
+bool enable_io_uring(asio::io_context&, const UringOptions&)
+{
+    WAR("io_uring transport is not compiled in, fall back to epoll");
+    return false;
+}
+
+#else
+
+namespace
+{
+    // 接收缓冲区环使用的缓冲区组编号
+    constexpr uint16_t BUFFER_GROUP = 0;
+
+    int sys_io_uring_setup(unsigned entries, io_uring_params* params)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+    }
+
+    int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+    }
+
+    int sys_io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+    }
+
+    [[noreturn]] void throw_errno(const char* what)
+    {
+        throw std::system_error(errno, std::system_category(), what);
+    }
+
+    template <typename T>
+    T load_acquire(const T* p)
+    {
+        return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+    }
+
+    template <typename T>
+    void store_release(T* p, T v)
+    {
+        __atomic_store_n(p, v, __ATOMIC_RELEASE);
+    }
+}
+
+asio::execution_context::id UringContext::id;
+
+bool enable_io_uring(asio::io_context& ioc, const UringOptions& options)
+{
+    if (asio::has_service<UringContext>(ioc)) {
+        return true;
+    }
+    try {
+        asio::make_service<UringContext>(ioc, ioc, options);
+        return true;
+    } catch (const std::exception& e) {
+        WAR("Failed to enable io_uring, fall back to epoll: {}", e.what());
+        return false;
+    }
+}
+
+UringContext* uring_of(asio::io_context& ioc)
+{
+    if (!asio::has_service<UringContext>(ioc)) {
+        return nullptr;
+    }
+    return &asio::use_service<UringContext>(ioc);
+}
+
+UringContext::UringContext(asio::execution_context& ctx, asio::io_context& ioc, const UringOptions& options) :
+    asio::execution_context::service(ctx),
+    ioc_(ioc),
+    event_(ioc)
+{
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    ring_fd_ = sys_io_uring_setup(options.entries, &params);
+    if (ring_fd_ < 0) {
+        throw_errno("io_uring_setup");
+    }
+
+    // 出错时由析构函数回收已经创建的资源
+    struct Guard {
+        UringContext* self;
+        ~Guard() { if (self) self->shutdown(); }
+    } guard{ this };
+
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_NODROP)) {
+        throw std::runtime_error("io_uring: kernel too old");
+    }
+
+    sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    sq_size_ = std::max(sq_size_, cq_size_);
+    sq_ptr_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   ring_fd_, IORING_OFF_SQ_RING);
+    if (sq_ptr_ == MAP_FAILED) {
+        sq_ptr_ = nullptr;
+        throw_errno("mmap sq ring");
+    }
+    cq_ptr_ = sq_ptr_;
+
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring_fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        throw_errno("mmap sqes");
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(sq_ptr_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_entries_ = params.sq_entries;
+    sq_local_tail_ = *sq_tail_;
+    // 提交队列的下标数组固定为恒等映射
+    unsigned* array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    for (unsigned i = 0; i < sq_entries_; ++i) {
+        array[i] = i;
+    }
+
+    char* cq = static_cast<char*>(cq_ptr_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    // 接收缓冲区环
+    buffer_count_ = options.buffer_count;
+    buffer_size_ = options.buffer_size;
+    if (buffer_count_ == 0 || (buffer_count_ & (buffer_count_ - 1)) || buffer_count_ > 32768) {
+        throw std::invalid_argument("io_uring: buffer_count must be a power of 2 not above 32768");
+    }
+    buf_ring_size_ = buffer_count_ * sizeof(io_uring_buf);
+    void* ring = mmap(nullptr, buf_ring_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        throw_errno("mmap buffer ring");
+    }
+    buf_ring_ = static_cast<io_uring_buf_ring*>(ring);
+    buffers_ = static_cast<char*>(mmap(nullptr, size_t(buffer_count_) * buffer_size_,
+                                       PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (buffers_ == MAP_FAILED) {
+        buffers_ = nullptr;
+        throw_errno("mmap buffers");
+    }
+
+    io_uring_buf_reg reg;
+    std::memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring_);
+    reg.ring_entries = buffer_count_;
+    reg.bgid = BUFFER_GROUP;
+    if (sys_io_uring_register(ring_fd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        throw_errno("io_uring_register pbuf ring");
+    }
+    for (unsigned i = 0; i < buffer_count_; ++i) {
+        recycle(i << IORING_CQE_BUFFER_SHIFT);
+    }
+
+    // 完成事件通过 eventfd 唤醒 io_context
+    event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event_fd_ < 0) {
+        throw_errno("eventfd");
+    }
+    if (sys_io_uring_register(ring_fd_, IORING_REGISTER_EVENTFD, &event_fd_, 1) < 0) {
+        throw_errno("io_uring_register eventfd");
+    }
+    event_.assign(event_fd_);
+    wait_event();
+
+    guard.self = nullptr;
+    INF("io_uring enabled: {} entries, {} x {} byte receive buffers",
+        sq_entries_, buffer_count_, buffer_size_);
+}
+
+UringContext::~UringContext()
+{
+    shutdown();
+}
+
+void UringContext::shutdown()
+{
+    if (ring_fd_ < 0) {
+        return;
+    }
+
+    // 取消所有在途操作并等待它们结束, 之后内核不会再访问所有者的内存
+    if (active_) {
+        io_uring_sqe* sqe = get_sqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+        sqe->user_data = 0;
+        submit();
+    }
+
+    std::vector<std::shared_ptr<void>> holds;
+    for (int round = 0; active_ && round < 1000; ++round) {
+        sys_io_uring_enter(ring_fd_, 0, 1, IORING_ENTER_GETEVENTS);
+        unsigned head = *cq_head_;
+        unsigned tail = load_acquire(cq_tail_);
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+            UringOp* op = reinterpret_cast<UringOp*>(cqe.user_data);
+            if (op && op->active && !(cqe.flags & IORING_CQE_F_MORE)) {
+                if (op->prev) op->prev->next = op->next; else active_ = op->next;
+                if (op->next) op->next->prev = op->prev;
+                op->active = false;
+                holds.push_back(std::move(op->hold));
+            }
+        }
+        store_release(cq_head_, head);
+    }
+    if (active_) {
+        ERR("io_uring: operations not finished at shutdown");
+    }
+
+    boost::system::error_code ec;
+    event_.close(ec);
+    event_fd_ = -1;
+
+    if (buffers_) munmap(buffers_, size_t(buffer_count_) * buffer_size_);
+    if (buf_ring_) munmap(buf_ring_, buf_ring_size_);
+    if (sqes_) munmap(sqes_, sqes_size_);
+    if (sq_ptr_) munmap(sq_ptr_, sq_size_);
+    ::close(ring_fd_);
+    ring_fd_ = -1;
+    buffers_ = nullptr;
+    buf_ring_ = nullptr;
+    sqes_ = nullptr;
+    sq_ptr_ = nullptr;
+    active_ = nullptr;
+}
+
+io_uring_sqe* UringContext::get_sqe()
+{
+    // 提交队列满时先把已有的请求交给内核
+    if (sq_local_tail_ - load_acquire(sq_head_) >= sq_entries_) {
+        submit();
+    }
+    io_uring_sqe* sqe = &sqes_[sq_local_tail_ & sq_mask_];
+    std::memset(sqe, 0, sizeof(*sqe));
+    ++sq_local_tail_;
+    return sqe;
+}
+
+void UringContext::start(io_uring_sqe* sqe, UringOp* op, std::shared_ptr<void> hold)
+{
+    sqe->user_data = reinterpret_cast<uint64_t>(op);
+    if (hold) {
+        op->hold = std::move(hold);
+    }
+    if (!op->active) {
+        op->active = true;
+        op->prev = nullptr;
+        op->next = active_;
+        if (active_) active_->prev = op;
+        active_ = op;
+    }
+
+    // 收割期间的请求在收割结束时统一提交, 其他时候推迟到 io_context 的下一轮
+    if (!reaping_ && !submit_posted_) {
+        submit_posted_ = true;
+        asio::post(ioc_, [this]() {
+            submit_posted_ = false;
+            submit();
+        });
+    }
+}
+
+void UringContext::recv_multishot(int fd, UringOp* op, std::shared_ptr<void> hold)
+{
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    start(sqe, op, std::move(hold));
+}
+
+void UringContext::sendmsg(int fd, const msghdr* msg, UringOp* op, std::shared_ptr<void> hold)
+{
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(msg);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    start(sqe, op, std::move(hold));
+}
+
+void UringContext::accept_multishot(int fd, UringOp* op, std::shared_ptr<void> hold)
+{
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    start(sqe, op, std::move(hold));
+}
+
+void UringContext::cancel(UringOp* op)
+{
+    if (!op->active) {
+        return;
+    }
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = reinterpret_cast<uint64_t>(op);
+    sqe->user_data = 0;
+    if (!reaping_ && !submit_posted_) {
+        submit_posted_ = true;
+        asio::post(ioc_, [this]() {
+            submit_posted_ = false;
+            submit();
+        });
+    }
+}
+
+const char* UringContext::buffer(uint32_t flags) const
+{
+    uint32_t bid = flags >> IORING_CQE_BUFFER_SHIFT;
+    return buffers_ + size_t(bid) * buffer_size_;
+}
+
+void UringContext::recycle(uint32_t flags)
+{
+    uint16_t bid = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+    // 缓冲区环的表项从环的起始地址开始, 与 tail 共用第一项的保留字段;
+    // C++ 下头文件中 bufs 成员的偏移不正确, 这里直接按地址计算
+    io_uring_buf* bufs = reinterpret_cast<io_uring_buf*>(buf_ring_);
+    io_uring_buf& buf = bufs[buf_tail_ & (buffer_count_ - 1)];
+    buf.addr = reinterpret_cast<uint64_t>(buffers_ + size_t(bid) * buffer_size_);
+    buf.len = buffer_size_;
+    buf.bid = bid;
+    ++buf_tail_;
+    store_release(&buf_ring_->tail, buf_tail_);
+}
+
+void UringContext::submit()
+{
+    unsigned pending = sq_local_tail_ - load_acquire(sq_head_);
+    if (pending == 0 || ring_fd_ < 0) {
+        return;
+    }
+    store_release(sq_tail_, sq_local_tail_);
+    int ret = sys_io_uring_enter(ring_fd_, pending, 0, 0);
+    if (ret < 0 && errno != EAGAIN && errno != EBUSY && errno != EINTR) {
+        ERR("io_uring_enter error: {}", strerror(errno));
+    }
+}
+
+void UringContext::wait_event()
+{
+    event_.async_read_some(asio::buffer(&event_count_, sizeof(event_count_)),
+        [this](boost::system::error_code ec, size_t) {
+            if (ec == asio::error::operation_aborted) {
+                return;
+            }
+            reap();
+            wait_event();
+        });
+}
+
+void UringContext::reap()
+{
+    reaping_ = true;
+    while (true) {
+        unsigned head = *cq_head_;
+        unsigned tail = load_acquire(cq_tail_);
+        if (head == tail) {
+            break;
+        }
+
+        for (; head != tail; ++head) {
+            io_uring_cqe cqe = cqes_[head & cq_mask_];
+            // 及时归还完成队列的位置
+            store_release(cq_head_, head + 1);
+
+            UringOp* op = reinterpret_cast<UringOp*>(cqe.user_data);
+            if (!op) {
+                continue; // 取消请求自身的完成事件
+            }
+
+            std::shared_ptr<void> hold;
+            if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                if (op->prev) op->prev->next = op->next; else active_ = op->next;
+                if (op->next) op->next->prev = op->prev;
+                op->active = false;
+                hold = std::move(op->hold);
+            }
+
+            try {
+                op->complete(cqe.res, cqe.flags);
+            } catch (const std::exception& e) {
+                ERR("io_uring completion error: {}", e.what());
+            }
+
+            // 回调中重新发起了同一操作, 沿用本次的所有者
+            if (hold && op->active && !op->hold) {
+                op->hold = std::move(hold);
+            }
+        }
+    }
+    reaping_ = false;
+    submit();
+}
+
+// UringStream 实现
+UringStream::UringStream(UringContext& ctx, int fd, Buffer& recv, Callbacks callbacks) :
+    ctx_(ctx),
+    fd_(fd),
+    recv_(recv),
+    callbacks_(std::move(callbacks))
+{
+    recv_op_.complete = [this](int res, uint32_t flags) { on_recv(res, flags); };
+    send_op_.complete = [this](int res, uint32_t) { on_send(res); };
+}
+
+UringStream::~UringStream()
+{
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+void UringStream::start(std::shared_ptr<void> hold)
+{
+    ctx_.recv_multishot(fd_, &recv_op_, std::move(hold));
+}
+
+void UringStream::shutdown()
+{
+    ::shutdown(fd_, SHUT_RDWR);
+}
+
+void UringStream::pause()
+{
+    if (paused_) {
+        return;
+    }
+    paused_ = true;
+    if (recv_op_.active) {
+        cancelling_ = true;
+        ctx_.cancel(&recv_op_);
+    }
+}
+
+void UringStream::resume(std::shared_ptr<void> hold)
+{
+    if (!paused_) {
+        return;
+    }
+    paused_ = false;
+    // 取消尚未完成时由其完成事件重新发起
+    if (!recv_op_.active) {
+        ctx_.recv_multishot(fd_, &recv_op_, std::move(hold));
+    }
+}
+
+void UringStream::on_recv(int res, uint32_t flags)
+{
+    if (res > 0) {
+        // 从内核挑选的缓冲区拷贝到会话自己的接收缓冲区, 半包数据留在其中等待后续数据
+        recv_.ensure_capacity(res);
+        std::memcpy(recv_.write_data(), ctx_.buffer(flags), res);
+        recv_.advance_write(res);
+        ctx_.recycle(flags);
+        callbacks_.on_data();
+    } else if (flags & IORING_CQE_F_BUFFER) {
+        ctx_.recycle(flags);
+    }
+
+    if (flags & IORING_CQE_F_MORE) {
+        return;
+    }
+
+    // 多发接收结束: 缓冲区暂时用尽、被内核截断或被 pause 取消时重新发起, 暂停期间留给 resume;
+    // 对端关闭或出错时通知所有者
+    bool cancelled = std::exchange(cancelling_, false);
+    if (res > 0 || res == -ENOBUFS || (res == -ECANCELED && cancelled)) {
+        if (!paused_) {
+            ctx_.recv_multishot(fd_, &recv_op_, nullptr);
+        }
+        return;
+    }
+    if (res < 0 && res != -ECANCELED && res != -ECONNRESET) {
+        ERR("io_uring recv error: {}", strerror(-res));
+    }
+    callbacks_.on_eof();
+}
+
+void UringStream::write(IOBuf& data, std::shared_ptr<void> hold)
+{
+    writing_ = &data;
+    send_pending();
+    if (hold) {
+        send_op_.hold = std::move(hold);
+    }
+}
+
+void UringStream::send_pending()
+{
+    iov_.clear();
+    for (const auto& slice : writing_->slices()) {
+        iov_.push_back({ const_cast<char*>(slice.data()), slice.length });
+    }
+    std::memset(&msg_, 0, sizeof(msg_));
+    msg_.msg_iov = iov_.data();
+    msg_.msg_iovlen = std::min<size_t>(iov_.size(), IOV_MAX);
+    ctx_.sendmsg(fd_, &msg_, &send_op_, nullptr);
+}
+
+void UringStream::on_send(int res)
+{
+    if (res < 0) {
+        writing_ = nullptr;
+        callbacks_.on_write(-res);
+        return;
+    }
+
+    // 部分发送时继续发送剩余的数据
+    writing_->pop_front(static_cast<size_t>(res));
+    if (!writing_->empty()) {
+        send_pending();
+        return;
+    }
+    writing_ = nullptr;
+    callbacks_.on_write(0);
+}
+
+#endif // NET_HAS_IO_URING
+
+} // namespace net
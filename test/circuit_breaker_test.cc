@@ -0,0 +1,220 @@
+#include <circuit_breaker.h>
+#include <command.h>
+#include "check.h"
+#include <thread>
+
+using namespace std::chrono_literals;
+using net::BreakerOptions;
+using net::BreakerState;
+using net::CircuitBreaker;
+using net::RpcStatus;
+
+namespace
+{
+
+BreakerOptions options()
+{
+    BreakerOptions o;
+    o.min_requests = 10;
+    o.error_rate = 0.5;
+    o.open_duration = 20ms;
+    o.probes = 3;
+    return o;
+}
+
+// 放行一个非探测请求并报告结果
+void call(CircuitBreaker& breaker, RpcStatus status, std::chrono::microseconds latency = 100us)
+{
+    uint64_t probe = 1;
+    CHECK(breaker.allow(probe));
+    CHECK_EQ(probe, 0u);
+    breaker.record(status, latency, probe);
+}
+
+// 连续失败直到熔断, 再等过熔断时间
+void open_and_wait(CircuitBreaker& breaker, const BreakerOptions& o)
+{
+    for (uint32_t i = 0; i < o.min_requests; ++i) {
+        call(breaker, RpcStatus::TIMEOUT);
+    }
+    CHECK(breaker.state() == BreakerState::OPEN);
+    std::this_thread::sleep_for(o.open_duration + 10ms);
+}
+
+// 调用数不足 min_requests 时全部失败也不熔断
+void test_volume_threshold()
+{
+    CircuitBreaker breaker(options(), "volume");
+    for (int i = 0; i < 9; ++i) {
+        call(breaker, RpcStatus::CONNECTION_CLOSED);
+    }
+    CHECK(breaker.state() == BreakerState::CLOSED);
+    call(breaker, RpcStatus::CONNECTION_CLOSED);
+    CHECK(breaker.state() == BreakerState::OPEN);
+    CHECK_EQ(breaker.opened(), 1u);
+}
+
+// 失败率达到 error_rate 时才熔断; 处理器错误不算失败, 超过 slow_call 的成功调用算失败
+void test_ratio_threshold()
+{
+    CircuitBreaker breaker(options(), "ratio");
+    for (int i = 0; i < 5; ++i) {
+        call(breaker, RpcStatus::OK);
+    }
+    call(breaker, RpcStatus::HANDLER_ERROR);
+    for (int i = 0; i < 4; ++i) {
+        call(breaker, RpcStatus::OVERLOADED);
+    }
+    CHECK(breaker.state() == BreakerState::CLOSED); // 4 / 10
+    call(breaker, RpcStatus::TIMEOUT);
+    CHECK(breaker.state() == BreakerState::CLOSED); // 5 / 11
+    call(breaker, RpcStatus::TIMEOUT);
+    CHECK(breaker.state() == BreakerState::OPEN);   // 6 / 12
+
+    BreakerOptions slow = options();
+    slow.slow_call = 1ms;
+    CircuitBreaker slow_breaker(slow, "slow");
+    for (int i = 0; i < 10; ++i) {
+        call(slow_breaker, RpcStatus::OK, 2ms);
+    }
+    CHECK(slow_breaker.state() == BreakerState::OPEN);
+}
+
+// 熔断期间拒绝, open_duration 之后第一次 allow 转入半开并作为探测放行
+void test_open_to_half_open()
+{
+    BreakerOptions o = options();
+    CircuitBreaker breaker(o, "half-open");
+    for (uint32_t i = 0; i < o.min_requests; ++i) {
+        call(breaker, RpcStatus::TIMEOUT);
+    }
+    uint64_t probe = 0;
+    CHECK(!breaker.allow(probe));
+    CHECK(breaker.state() == BreakerState::OPEN);
+
+    std::this_thread::sleep_for(o.open_duration + 10ms);
+    CHECK(breaker.state() == BreakerState::OPEN); // 只在 allow 时转换
+    CHECK(breaker.allow(probe));
+    CHECK(probe != 0);
+    CHECK(breaker.state() == BreakerState::HALF_OPEN);
+    CHECK_EQ(breaker.half_opened(), 1u);
+}
+
+// 半开时最多放行 probes 个探测, 全部成功后才恢复; 取消的探测归还名额
+void test_recovery()
+{
+    BreakerOptions o = options();
+    CircuitBreaker breaker(o, "recovery");
+    open_and_wait(breaker, o);
+
+    uint64_t probes[3];
+    for (uint64_t& probe : probes) {
+        CHECK(breaker.allow(probe));
+        CHECK(probe != 0);
+    }
+    uint64_t extra = 0;
+    CHECK(!breaker.allow(extra));
+
+    breaker.release(probes[2]);
+    CHECK(breaker.allow(probes[2]));
+    CHECK(!breaker.allow(extra));
+
+    breaker.record(RpcStatus::OK, 100us, probes[0]);
+    breaker.record(RpcStatus::OK, 100us, probes[1]);
+    CHECK(breaker.state() == BreakerState::HALF_OPEN);
+    breaker.record(RpcStatus::OK, 100us, probes[2]);
+    CHECK(breaker.state() == BreakerState::CLOSED);
+    CHECK_EQ(breaker.closed(), 1u);
+
+    // 恢复后窗口清空, 需要重新积累 min_requests 个调用才会熔断
+    for (int i = 0; i < 9; ++i) {
+        call(breaker, RpcStatus::TIMEOUT);
+    }
+    CHECK(breaker.state() == BreakerState::CLOSED);
+}
+
+// 任何一个探测失败都重新熔断, 之后的探测结果不再影响状态
+void test_reopen_on_probe_failure()
+{
+    BreakerOptions o = options();
+    CircuitBreaker breaker(o, "reopen");
+    open_and_wait(breaker, o);
+
+    uint64_t first = 0, second = 0;
+    CHECK(breaker.allow(first));
+    CHECK(breaker.allow(second));
+    breaker.record(RpcStatus::OK, 100us, first);
+    breaker.record(RpcStatus::CONNECTION_CLOSED, 100us, second);
+    CHECK(breaker.state() == BreakerState::OPEN);
+    CHECK_EQ(breaker.opened(), 2u);
+
+    uint64_t probe = 0;
+    CHECK(!breaker.allow(probe));
+
+    // 上一轮的探测在下一轮半开时返回, 不计入新一轮的结果
+    std::this_thread::sleep_for(o.open_duration + 10ms);
+    uint64_t next = 0;
+    CHECK(breaker.allow(next));
+    CHECK(next != first);
+    for (int i = 0; i < 3; ++i) {
+        breaker.record(RpcStatus::OK, 100us, first);
+    }
+    CHECK(breaker.state() == BreakerState::HALF_OPEN);
+    breaker.record(RpcStatus::TIMEOUT, 100us, first);
+    CHECK(breaker.state() == BreakerState::HALF_OPEN);
+}
+
+// 熔断之前放行的非探测请求在半开时返回, 既不能使熔断器恢复, 也不能使它重新熔断
+void test_late_results_ignored()
+{
+    BreakerOptions o = options();
+    CircuitBreaker breaker(o, "late");
+    uint64_t late_ok = 1, late_fail = 1;
+    CHECK(breaker.allow(late_ok));
+    CHECK(breaker.allow(late_fail));
+    open_and_wait(breaker, o);
+
+    uint64_t probe = 0;
+    CHECK(breaker.allow(probe));
+    CHECK(breaker.state() == BreakerState::HALF_OPEN);
+    for (int i = 0; i < 3; ++i) {
+        breaker.record(RpcStatus::OK, 100us, late_ok);
+    }
+    CHECK(breaker.state() == BreakerState::HALF_OPEN);
+    breaker.record(RpcStatus::TIMEOUT, 100us, late_fail);
+    CHECK(breaker.state() == BreakerState::HALF_OPEN);
+    breaker.release(late_ok);
+
+    // 非探测请求的 release 不归还探测名额
+    uint64_t second = 0, third = 0, extra = 0;
+    CHECK(breaker.allow(second));
+    CHECK(breaker.allow(third));
+    CHECK(!breaker.allow(extra));
+}
+
+void test_disabled()
+{
+    BreakerOptions o = options();
+    o.enabled = false;
+    CircuitBreaker breaker(o, "disabled");
+    for (int i = 0; i < 100; ++i) {
+        call(breaker, RpcStatus::TIMEOUT);
+    }
+    CHECK(breaker.state() == BreakerState::CLOSED);
+}
+
+} // namespace
+
+int main()
+{
+    init_global_logging();
+    test_volume_threshold();
+    test_ratio_threshold();
+    test_open_to_half_open();
+    test_recovery();
+    test_reopen_on_probe_failure();
+    test_late_results_ignored();
+    test_disabled();
+    INF("circuit_breaker_test passed");
+    return 0;
+}
@@ -1,62 +1,53 @@
 #include <etcd.h>
-#include <net.h>
+#include <channel_pool.h>
 #include <test.pb.h>
 #include <protocol.h>
 const std::string etcd_addr = "http://127.0.0.1:2379";
 
+// 所有节点的连接共享同一组 io 线程
+auto channel_pool = std::make_shared<net::ChannelPool>(2);
+// 发起调用的协程运行在这里
+boost::asio::io_context caller_ioc;
+
 void online_callback(const std::string& service_name, const std::string& endpoint)
 {
     INF("{}服务上线了, endpoint={}", service_name, endpoint);
-    // 发送一个Protobuf数据
-    boost::asio::io_context ioc_;
-    const std::string host = endpoint.substr(0, endpoint.find(':'));
-    std::string port = endpoint.substr(endpoint.find(':') + 1);
-    std::shared_ptr<net::Client> client = std::make_shared<net::Client>(ioc_, host, port, 
-        [](net::Buffer& recv)
-        {
-            // 解析Protobuf数据
-            std::string recv_str = recv.read_all_as_string();
-            INF("收到{}字节的数据", recv_str.size());
+    // 上线即建立连接, 第一次调用时无需再等待连接
+    channel_pool->add_node(service_name, endpoint);
 
-            static ProtocolTools::BufferHandler buffer_handler;
-            buffer_handler.append(recv_str.data(), recv_str.size());
-            
-            ProtocolTools::LVProtocol message;
-            while (buffer_handler.get_next_message(message)) {
-                INF("处理消息, 类型: {}, 长度: {}", 
-                (message.type == ProtocolType::PROTOBUF ? "Protobuf" : "JSON"), 
-                message.length);
-                AddResponse response;
-                response.ParseFromString(message.data);
-                INF("结果: {}", response.result());
+    // 同一连接上同时发起多个协程调用, 每个协程挂起直到收到自己的响应
+    for (int i = 0; i < 3; ++i)
+    {
+        boost::asio::co_spawn(caller_ioc, [service_name, i]() -> boost::asio::awaitable<void>
+        {
+            AddRequest request;
+            request.set_a(i);
+            request.set_b(2);
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+            auto result = co_await channel_pool->call<AddRequest, AddResponse>(service_name, "Add", request, deadline);
+            if (!result.ok())
+            {
+                ERR("第{}个请求失败: {}", i, static_cast<int>(result.status));
+                co_return;
             }
-        });
-    client->start();
-    boost::asio::io_context::work work(ioc_);
-    std::thread([&ioc_]() { ioc_.run(); }).detach();
-    // 等待连接建立
-    std::this_thread::sleep_for(std::chrono::seconds(1));
-    // 发送数据
-
-    AddRequest request;
-    request.set_a(1);
-    request.set_b(2);
-    std::string packed_data;
-    ProtocolTools::pack_protobuf(request, &packed_data);
-    client->send(packed_data);
-
-    std::this_thread::sleep_for(std::chrono::seconds(10));
+            INF("第{}个请求的结果: {}", i, result.response.result());
+        }, boost::asio::detached);
+    }
 }
 
 void offline_callback(const std::string& service_name, const std::string& endpoint)
 {
     INF("{}服务下线了, endpoint={}", service_name, endpoint);
+    channel_pool->remove_node(service_name, endpoint);
 }
 
 
 
 void test_etcd_discovery()
 {   
+    boost::asio::io_context::work work(caller_ioc);
+    std::thread caller([]() { caller_ioc.run(); });
+
     // 创建一个服务的发现者
     auto discovery = std::make_shared<Tools::ServiceDiscovery>(etcd_addr, online_callback, offline_callback);
 
@@ -64,6 +55,10 @@ void test_etcd_discovery()
 
     INF("等待服务上线...");
     getchar();
+
+    caller_ioc.stop();
+    caller.join();
+    channel_pool->stop();
 }
 int main()
 {
@@ -0,0 +1,125 @@
+#include <hedge.h>
+#include <command.h>
+#include "check.h"
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace std::chrono_literals;
+using net::HedgePolicy;
+using net::HedgeState;
+using net::LatencyWindow;
+
+namespace
+{
+
+// 按打乱的顺序记录 1..n 微秒
+void record_shuffled(LatencyWindow& window, int n)
+{
+    std::vector<int> values(n);
+    for (int i = 0; i < n; ++i) {
+        values[i] = i + 1;
+    }
+    std::shuffle(values.begin(), values.end(), std::mt19937(42));
+    for (int v : values) {
+        window.record(std::chrono::microseconds(v));
+    }
+}
+
+// 样本少于 MIN_SAMPLES 时不给出分位数
+void test_min_samples()
+{
+    LatencyWindow window;
+    for (size_t i = 1; i < LatencyWindow::MIN_SAMPLES; ++i) {
+        window.record(100us);
+        CHECK_EQ(window.percentile(0.95), 0us);
+    }
+    window.record(100us);
+    CHECK_EQ(window.percentile(0.95), 100us);
+}
+
+// 最近排名法: 第 p 分位是升序第 ceil(p * n) 个样本
+void test_nearest_rank()
+{
+    LatencyWindow window;
+    record_shuffled(window, 100);
+    CHECK_EQ(window.percentile(0.95), 95us);
+    CHECK_EQ(window.percentile(0.5), 50us);
+    CHECK_EQ(window.percentile(0.99), 99us);
+    CHECK_EQ(window.percentile(1.0), 100us);
+    CHECK_EQ(window.percentile(0.0), 1us);
+    CHECK_EQ(window.percentile(0.001), 1us);
+}
+
+// 同一分位的结果缓存, 新记录满 RECOMPUTE 个样本后才重新计算; 换一个分位立即重新计算
+void test_cache()
+{
+    LatencyWindow window;
+    record_shuffled(window, 100);
+    CHECK_EQ(window.percentile(1.0), 100us);
+    for (int i = 0; i < 31; ++i) {
+        window.record(1000us);
+    }
+    CHECK_EQ(window.percentile(1.0), 100us);
+    window.record(1000us);
+    CHECK_EQ(window.percentile(1.0), 1000us);
+
+    window.record(2000us);
+    CHECK_EQ(window.percentile(1.0), 1000us);
+    CHECK_EQ(window.percentile(0.5), 67us); // 133 个样本的第 67 个
+    CHECK_EQ(window.percentile(1.0), 2000us);
+}
+
+// 只保留最近 SIZE 个样本, 更早的被覆盖
+void test_window()
+{
+    LatencyWindow window;
+    for (size_t i = 0; i < LatencyWindow::SIZE; ++i) {
+        window.record(5000us);
+    }
+    CHECK_EQ(window.percentile(0.0), 5000us);
+    for (size_t i = 0; i < LatencyWindow::SIZE - 1; ++i) {
+        window.record(10us);
+    }
+    CHECK_EQ(window.percentile(1.0), 5000us);
+    // 最后一个 5000us 被覆盖, 再记满 RECOMPUTE 个样本使缓存失效
+    for (int i = 0; i < 32; ++i) {
+        window.record(10us);
+    }
+    CHECK_EQ(window.percentile(1.0), 10us);
+}
+
+// 对冲延迟不低于 min_delay, 样本不足时不对冲
+void test_hedge_delay()
+{
+    HedgePolicy policy;
+    policy.percentile = 0.9;
+    policy.min_delay = 1ms;
+    HedgeState state(policy);
+    CHECK_EQ(state.delay(), 0us);
+
+    for (int i = 0; i < 40; ++i) {
+        state.latency.record(200us);
+    }
+    CHECK_EQ(state.delay(), 1000us);
+
+    HedgeState slow(policy);
+    for (int i = 1; i <= 100; ++i) {
+        slow.latency.record(std::chrono::microseconds(i * 100));
+    }
+    CHECK_EQ(slow.delay(), 9000us);
+}
+
+} // namespace
+
+int main()
+{
+    init_global_logging();
+    test_min_samples();
+    test_nearest_rank();
+    test_cache();
+    test_window();
+    test_hedge_delay();
+    INF("hedge_test passed");
+    return 0;
+}
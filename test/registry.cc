@@ -6,15 +6,19 @@
 const std::string etcd_addr = "http://127.0.0.1:2379";
 
 void test_registry() {
+    // 同时在 Unix 域套接字上监听, 同主机的调用方会自动改走它
+    net::ProviderOptions options;
+    options.unix_path = "/tmp/add_service.sock";
+    std::shared_ptr<net::Provider> net_provider = std::make_shared<net::Provider>(8080, options);
+
     std::shared_ptr<Tools::ServiceProvider> provider
         = std::make_shared<Tools::ServiceProvider>(etcd_addr);
-    // 注册服务
-    provider->register_service("127.0.0.1:8080", "Add");
-
-    std::shared_ptr<net::Provider> net_provider = std::make_shared<net::Provider>(8080);
+    // 注册服务, 发布的地址为 "127.0.0.1:8080,unix:/tmp/add_service.sock"
+    std::string endpoint = net_provider->advertised_endpoint("127.0.0.1");
+    provider->register_service(endpoint, "Add");
 
     
-    net_provider->register_protobuf_handler<AddRequest, AddResponse>(
+    net_provider->register_protobuf_handler<AddRequest, AddResponse>("Add",
     [](const AddRequest& req, AddResponse& rsp) {
         rsp.set_result(req.a() + req.b());
     });
@@ -0,0 +1,131 @@
+#include <retry.h>
+#include <command.h>
+#include "check.h"
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+using net::RetryBudget;
+using net::RetryPolicy;
+using net::RpcStatus;
+
+namespace
+{
+
+// 预算从满桶开始, 取完之后拒绝并计数
+void test_initial_tokens()
+{
+    RetryBudget budget(0.1, 3);
+    CHECK_EQ(budget.tokens(), 3.0);
+    for (int i = 0; i < 3; ++i) {
+        CHECK(budget.try_withdraw());
+    }
+    CHECK(!budget.try_withdraw());
+    CHECK(!budget.try_withdraw());
+    CHECK_EQ(budget.tokens(), 0.0);
+    CHECK_EQ(budget.retries(), 3u);
+    CHECK_EQ(budget.rejected(), 2u);
+}
+
+// 每个请求存入 ratio 个令牌, 不足一个令牌时不能重试, 不会超过 max_tokens
+void test_deposit()
+{
+    RetryBudget budget(0.1, 2);
+    CHECK(budget.try_withdraw());
+    CHECK(budget.try_withdraw());
+
+    for (int i = 0; i < 9; ++i) {
+        budget.deposit();
+    }
+    CHECK(!budget.try_withdraw());
+    budget.deposit();
+    CHECK(budget.try_withdraw());
+    CHECK(!budget.try_withdraw());
+
+    for (int i = 0; i < 1000; ++i) {
+        budget.deposit();
+    }
+    CHECK_EQ(budget.tokens(), 2.0);
+}
+
+// 所有请求都失败并尝试重试时, 重试数不超过 max_tokens + ratio * 请求数
+void test_ratio()
+{
+    RetryBudget budget(0.1, 10);
+    for (int i = 0; i < 1000; ++i) {
+        budget.deposit();
+        budget.try_withdraw();
+    }
+    // 第一次存入时桶是满的, 之后 999 次存入共 99.9 个令牌
+    CHECK_EQ(budget.retries(), 10u + 99u);
+    CHECK_EQ(budget.retries() + budget.rejected(), 1000u);
+}
+
+// 并发取令牌时取出的总数等于桶中的令牌数
+void test_concurrent_withdraw()
+{
+    RetryBudget budget(0.1, 1000);
+    std::atomic<uint64_t> granted{ 0 };
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < 1000; ++i) {
+                granted += budget.try_withdraw();
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    CHECK_EQ(granted.load(), 1000u);
+    CHECK_EQ(budget.retries(), 1000u);
+    CHECK_EQ(budget.rejected(), 7000u);
+}
+
+void test_retryable()
+{
+    RetryPolicy policy;
+    CHECK(policy.retryable(RpcStatus::OVERLOADED));
+    CHECK(policy.retryable(RpcStatus::NO_ENDPOINT));
+    CHECK(!policy.retryable(RpcStatus::CONNECTION_CLOSED));
+    CHECK(!policy.retryable(RpcStatus::OK));
+}
+
+// 退避时间在 [0, min(max_backoff, initial_backoff * multiplier^(attempt-1))] 内
+void test_backoff_bounds()
+{
+    RetryPolicy policy;
+    policy.initial_backoff = 10ms;
+    policy.max_backoff = 100ms;
+    policy.multiplier = 2.0;
+    const std::chrono::milliseconds caps[] = { 10ms, 20ms, 40ms, 80ms, 100ms, 100ms };
+    for (int attempt = 1; attempt <= 6; ++attempt) {
+        std::chrono::milliseconds longest{ 0 };
+        for (int i = 0; i < 1000; ++i) {
+            std::chrono::milliseconds delay = policy.backoff(attempt);
+            CHECK(delay >= 0ms);
+            CHECK(delay <= caps[attempt - 1]);
+            longest = std::max(longest, delay);
+        }
+        // 抖动在整个区间内取值
+        CHECK(longest >= caps[attempt - 1] / 2);
+    }
+
+    policy.initial_backoff = 0ms;
+    CHECK_EQ(policy.backoff(3), 0ms);
+}
+
+} // namespace
+
+int main()
+{
+    init_global_logging();
+    test_initial_tokens();
+    test_deposit();
+    test_ratio();
+    test_concurrent_withdraw();
+    test_retryable();
+    test_backoff_bounds();
+    INF("retry_test passed");
+    return 0;
+}
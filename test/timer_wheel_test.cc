@@ -0,0 +1,203 @@
+#include <timer_wheel.h>
+#include <command.h>
+#include "check.h"
+#include <algorithm>
+#include <vector>
+
+using namespace std::chrono_literals;
+using net::TimerWheel;
+
+namespace
+{
+
+// 以虚拟时间驱动一个 io_context 上的时间轮, 记录每个定时器触发时的刻度
+struct VirtualWheel
+{
+    net::asio::io_context ioc;
+    TimerWheel& wheel = net::timer_wheel(ioc);
+    TimerWheel::clock::time_point base = TimerWheel::clock::now();
+    TimerWheel::clock::time_point now = base;
+    std::vector<std::pair<int, uint64_t>> fired; // (定时器编号, 触发时的刻度)
+
+    VirtualWheel() { wheel.set_time_source([this]() { return now; }); }
+
+    uint64_t tick() const { return static_cast<uint64_t>((now - base) / TimerWheel::TICK); }
+    void advance_to(uint64_t tick)
+    {
+        now = base + TimerWheel::TICK * tick;
+        wheel.poll();
+    }
+    net::TimerId add(int id, std::chrono::milliseconds delay)
+    {
+        return wheel.add(delay, [this, id]() { fired.emplace_back(id, tick()); });
+    }
+    bool has_fired(int id) const
+    {
+        return std::any_of(fired.begin(), fired.end(), [id](const auto& f) { return f.first == id; });
+    }
+};
+
+// 每个定时器恰好在到期刻度触发: 到期前一刻度推进时不触发, 推进到到期刻度时触发
+void expect_exact(VirtualWheel& w, const std::vector<uint64_t>& delays)
+{
+    uint64_t start = w.tick();
+    for (size_t i = 0; i < delays.size(); ++i) {
+        w.add(static_cast<int>(i), std::chrono::milliseconds(delays[i]));
+    }
+    std::vector<size_t> order(delays.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return delays[a] < delays[b]; });
+
+    for (size_t i : order) {
+        uint64_t expire = start + delays[i];
+        w.advance_to(expire - 1);
+        CHECK(!w.has_fired(static_cast<int>(i)));
+        w.advance_to(expire);
+        CHECK(w.has_fired(static_cast<int>(i)));
+    }
+    CHECK_EQ(w.fired.size(), delays.size());
+    for (size_t i = 0; i < delays.size(); ++i) {
+        CHECK_EQ(w.fired[i].first, static_cast<int>(order[i]));
+        CHECK_EQ(w.fired[i].second, start + delays[order[i]]);
+    }
+    CHECK_EQ(w.wheel.size(), 0u);
+}
+
+// 各层的边界: 64, 4096, 262144 个刻度, 以及超出顶层范围 (2^24) 后重新放置的定时器
+void test_cascade_boundaries()
+{
+    const std::vector<uint64_t> delays = { 1, 63, 64, 65, 127, 128, 4095, 4096, 4097, 262143, 262144, 262145,
+                                           (uint64_t(1) << 24) - 1, (uint64_t(1) << 24) + 5 };
+    {
+        VirtualWheel w;
+        expect_exact(w, delays);
+    }
+    // 起点不在边界上时同样要在到期刻度触发
+    {
+        VirtualWheel w;
+        w.advance_to(37);
+        expect_exact(w, delays);
+    }
+    {
+        VirtualWheel w;
+        w.advance_to(4096 * 3 - 1);
+        expect_exact(w, delays);
+    }
+}
+
+void test_cancel()
+{
+    VirtualWheel w;
+    net::TimerId a = w.add(1, 10ms);
+    net::TimerId b = w.add(2, 5000ms); // 第二层
+    w.add(3, 20ms);
+    CHECK_EQ(w.wheel.size(), 3u);
+    w.wheel.cancel(a);
+    w.wheel.cancel(b);
+    w.wheel.cancel(a); // 重复取消什么也不做
+    w.wheel.cancel(0);
+    CHECK_EQ(w.wheel.size(), 1u);
+    w.advance_to(20);
+    CHECK_EQ(w.fired.size(), 1u);
+    CHECK_EQ(w.fired[0].first, 3);
+    CHECK_EQ(w.fired[0].second, 20u);
+    w.advance_to(6000);
+    CHECK_EQ(w.fired.size(), 1u);
+}
+
+// 到期后的句柄失效, 不会取消复用同一节点的新定时器
+void test_cancel_after_fire()
+{
+    VirtualWheel w;
+    net::TimerId old = w.add(1, 5ms);
+    w.advance_to(5);
+    CHECK(w.has_fired(1));
+    net::TimerId reused = w.add(2, 5ms);
+    CHECK(reused != old);
+    w.wheel.cancel(old);
+    CHECK_EQ(w.wheel.size(), 1u);
+    w.advance_to(10);
+    CHECK(w.has_fired(2));
+}
+
+// 已过的时刻在下一个刻度触发
+void test_add_at_past()
+{
+    VirtualWheel w;
+    w.advance_to(100);
+    w.wheel.add_at(w.now - 50ms, [&w]() { w.fired.emplace_back(1, w.tick()); });
+    w.wheel.add_at(w.now, [&w]() { w.fired.emplace_back(2, w.tick()); });
+    w.advance_to(100);
+    CHECK(w.fired.empty());
+    w.advance_to(101);
+    CHECK_EQ(w.fired.size(), 2u);
+    CHECK_EQ(w.fired[0].second, 101u);
+    CHECK_EQ(w.fired[1].second, 101u);
+}
+
+// 回调中添加的定时器最早在下一个刻度触发, 不会在同一次推进中无限循环
+void test_add_from_callback()
+{
+    VirtualWheel w;
+    w.wheel.add(10ms, [&w]() {
+        w.fired.emplace_back(1, w.tick());
+        w.add(2, 0ms);
+        w.add(3, 70ms); // 跨过第一层的边界
+    });
+    w.advance_to(10);
+    CHECK_EQ(w.fired.size(), 1u);
+    w.advance_to(11);
+    CHECK_EQ(w.fired.size(), 2u);
+    CHECK_EQ(w.fired[1].first, 2);
+    CHECK_EQ(w.fired[1].second, 11u);
+    w.advance_to(79);
+    CHECK_EQ(w.fired.size(), 2u);
+    w.advance_to(80);
+    CHECK_EQ(w.fired.size(), 3u);
+    CHECK_EQ(w.fired[2].second, 80u);
+}
+
+// 以真实时间运行 io_context: 按到期顺序触发, 不早于到期时间, 定时器都结束后 run 返回
+void test_real_time()
+{
+    net::asio::io_context ioc;
+    std::vector<int> order;
+    auto start = TimerWheel::clock::now();
+    std::vector<std::chrono::milliseconds> elapsed(3);
+    auto record = [&](int id) {
+        return [&, id]() {
+            order.push_back(id);
+            elapsed[id] = std::chrono::duration_cast<std::chrono::milliseconds>(TimerWheel::clock::now() - start);
+        };
+    };
+    net::asio::post(ioc, [&]() {
+        TimerWheel& wheel = net::timer_wheel(ioc);
+        wheel.add(30ms, record(2));
+        wheel.add(10ms, record(0));
+        wheel.add(20ms, record(1));
+        net::TimerId cancelled = wheel.add(15ms, []() { CHECK(false); });
+        wheel.cancel(cancelled);
+    });
+    ioc.run();
+    CHECK((order == std::vector<int>{ 0, 1, 2 }));
+    CHECK(elapsed[0] >= 10ms);
+    CHECK(elapsed[1] >= 20ms);
+    CHECK(elapsed[2] >= 30ms);
+}
+
+} // namespace
+
+int main()
+{
+    init_global_logging();
+    test_cascade_boundaries();
+    test_cancel();
+    test_cancel_after_fire();
+    test_add_at_past();
+    test_add_from_callback();
+    test_real_time();
+    INF("timer_wheel_test passed");
+    return 0;
+}
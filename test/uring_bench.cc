@@ -0,0 +1,122 @@
+#include <server.h>
+#include <channel.h>
+#include <command.h>
+#include "test.pb.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+// 本机回环压测: 分别以 epoll 和 io_uring 传输运行同一个 Add 服务, 比较吞吐
+DEFINE_int32(bench_port, 18300, "压测服务的起始端口");
+DEFINE_int32(bench_connections, 8, "客户端连接数");
+DEFINE_int32(bench_depth, 32, "每个连接上同时在途的请求数");
+DEFINE_int32(bench_seconds, 5, "每种传输的压测时长, 单位秒");
+DEFINE_int32(bench_io_threads, 2, "服务端 io 线程数");
+
+namespace
+{
+
+struct BenchResult
+{
+    uint64_t ok = 0;
+    uint64_t failed = 0;
+};
+
+// 每个请求完成后立即在同一连接上发出下一个, 保持固定的在途请求数
+void issue(const std::shared_ptr<net::Channel>& channel, const std::string& body,
+           std::atomic<bool>& running, std::atomic<uint64_t>& ok, std::atomic<uint64_t>& failed)
+{
+    std::weak_ptr<net::Channel> weak = channel;
+    channel->async_call(ProtocolType::PROTOBUF, "Add", body,
+        [weak, &body, &running, &ok, &failed](net::RpcStatus status, const FrameView&) {
+            (status == net::RpcStatus::OK ? ok : failed).fetch_add(1, std::memory_order_relaxed);
+            auto channel = weak.lock();
+            if (channel && running.load(std::memory_order_relaxed)) {
+                issue(channel, body, running, ok, failed);
+            }
+        });
+}
+
+BenchResult run(net::Transport transport, int port)
+{
+    net::ProviderOptions options;
+    options.io_threads = FLAGS_bench_io_threads;
+    options.transport = transport;
+    net::Provider provider(port, options);
+    provider.register_protobuf_handler<AddRequest, AddResponse>("Add",
+        [](const AddRequest& req, AddResponse& rsp) {
+            rsp.set_result(req.a() + req.b());
+        });
+    provider.start();
+
+    asio::io_context ioc{ 1 };
+    if (transport == net::Transport::IO_URING) {
+        net::enable_io_uring(ioc);
+    }
+
+    std::vector<std::shared_ptr<net::Channel>> channels;
+    for (int i = 0; i < FLAGS_bench_connections; ++i) {
+        auto channel = std::make_shared<net::Channel>(ioc, "127.0.0.1", std::to_string(port));
+        channel->start();
+        channels.push_back(channel);
+    }
+
+    AddRequest req;
+    req.set_a(1);
+    req.set_b(2);
+    std::string body;
+    req.SerializeToString(&body);
+
+    std::atomic<bool> running{ true };
+    std::atomic<uint64_t> ok{ 0 };
+    std::atomic<uint64_t> failed{ 0 };
+    for (auto& channel : channels) {
+        for (int i = 0; i < FLAGS_bench_depth; ++i) {
+            issue(channel, body, running, ok, failed);
+        }
+    }
+
+    auto work = asio::make_work_guard(ioc);
+    std::thread thread([&ioc]() { ioc.run(); });
+
+    // 预热一秒后开始计数
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    uint64_t ok_start = ok.load();
+    uint64_t failed_start = failed.load();
+    std::this_thread::sleep_for(std::chrono::seconds(FLAGS_bench_seconds));
+    BenchResult result{ ok.load() - ok_start, failed.load() - failed_start };
+
+    running = false;
+    for (auto& channel : channels) {
+        channel->close();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    work.reset();
+    ioc.stop();
+    thread.join();
+    provider.stop();
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    // 压测时默认只输出警告以上的日志
+    FLAGS_log_level = 3;
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+    init_global_logging();
+
+    BenchResult epoll = run(net::Transport::EPOLL, FLAGS_bench_port);
+    BenchResult uring = run(net::Transport::IO_URING, FLAGS_bench_port + 1);
+
+    auto report = [](const char* name, const BenchResult& result) {
+        printf("%-9s %10.0f req/s, %llu failed\n", name,
+               double(result.ok) / FLAGS_bench_seconds, (unsigned long long)result.failed);
+    };
+    printf("connections: %d, depth: %d, io threads: %d, %d s\n",
+           FLAGS_bench_connections, FLAGS_bench_depth, FLAGS_bench_io_threads, FLAGS_bench_seconds);
+    report("epoll", epoll);
+    report("io_uring", uring);
+    return 0;
+}